@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <errno.h>
+#include <cstring>
+#include <stdlib.h>
+#include <assert.h>
+#include "buffered_reader.h"
+#include "xfiber.h"
+
+
+BufferPool::~BufferPool() {
+    for (size_t i = 0; i < free_blocks_.size(); i++) {
+        for (size_t j = 0; j < free_blocks_[i].size(); j++) {
+            free(free_blocks_[i][j]);
+        }
+    }
+}
+
+int BufferPool::SizeClass(size_t size) {
+    int cls = 0;
+    size_t block_size = MIN_BLOCK_SIZE;
+    while (block_size < size) {
+        block_size <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+char *BufferPool::Allocate(size_t &size) {
+    int cls = SizeClass(size);
+    size = MIN_BLOCK_SIZE << cls;
+    if (size <= MAX_POOLED_SIZE && (size_t)cls < free_blocks_.size() && !free_blocks_[cls].empty()) {
+        char *buf = free_blocks_[cls].back();
+        free_blocks_[cls].pop_back();
+        return buf;
+    }
+    char *buf = (char *)malloc(size);
+    if (buf == nullptr) {
+        LOG_ERROR("allocate read buffer of %lu bytes failed", size);
+        exit(-1);
+    }
+    return buf;
+}
+
+void BufferPool::Free(char *buf, size_t size) {
+    if (buf == nullptr) {
+        return;
+    }
+    int cls = SizeClass(size);
+    if (size > MAX_POOLED_SIZE || size != (MIN_BLOCK_SIZE << cls)) {
+        free(buf);
+        return;
+    }
+    if ((size_t)cls >= free_blocks_.size()) {
+        free_blocks_.resize(cls + 1);
+    }
+    if (free_blocks_[cls].size() >= MAX_BLOCKS_PER_CLASS) {
+        free(buf);
+        return;
+    }
+    free_blocks_[cls].push_back(buf);
+}
+
+
+ReadBuffer::ReadBuffer(size_t init_size, size_t max_size) {
+    buf_ = nullptr;
+    cap_ = 0;
+    init_size_ = init_size;
+    max_size_ = max_size;
+    rpos_ = 0;
+    wpos_ = 0;
+}
+
+ReadBuffer::~ReadBuffer() {
+    BufferPool::Instance()->Free(buf_, cap_);
+    buf_ = nullptr;
+}
+
+char *ReadBuffer::Data() {
+    return buf_ + rpos_;
+}
+
+size_t ReadBuffer::Size() const {
+    return wpos_ - rpos_;
+}
+
+void ReadBuffer::Consume(size_t n) {
+    assert(n <= Size());
+    rpos_ += n;
+    if (rpos_ == wpos_) {
+        rpos_ = 0;
+        wpos_ = 0;
+    }
+}
+
+void ReadBuffer::Clear() {
+    rpos_ = 0;
+    wpos_ = 0;
+}
+
+bool ReadBuffer::Reserve() {
+    if (buf_ == nullptr) {
+        cap_ = init_size_;
+        buf_ = BufferPool::Instance()->Allocate(cap_);
+        return true;
+    }
+
+    // 尾部空间不足1/4时整理，把未消费数据挪到头部
+    if (rpos_ > 0 && cap_ - wpos_ < cap_ / 4) {
+        memmove(buf_, buf_ + rpos_, wpos_ - rpos_);
+        wpos_ -= rpos_;
+        rpos_ = 0;
+    }
+    if (wpos_ < cap_) {
+        return true;
+    }
+
+    if (cap_ >= max_size_) {
+        LOG_WARNING("read buffer exceeds %lu bytes", max_size_);
+        return false;
+    }
+    size_t new_cap = cap_ * 2;
+    char *new_buf = BufferPool::Instance()->Allocate(new_cap);
+    memcpy(new_buf, buf_ + rpos_, wpos_ - rpos_);
+    BufferPool::Instance()->Free(buf_, cap_);
+    buf_ = new_buf;
+    cap_ = new_cap;
+    wpos_ -= rpos_;
+    rpos_ = 0;
+    return true;
+}
+
+ssize_t ReadBuffer::Fill(const Connection &conn, int timeout_ms) {
+    if (!Reserve()) {
+        return -1;
+    }
+    ssize_t n = conn.Read(buf_ + wpos_, cap_ - wpos_, timeout_ms);
+    if (n > 0) {
+        wpos_ += n;
+    }
+    return n;
+}
+
+
+BufferedReader::BufferedReader(const Connection &conn, size_t init_size, size_t max_size)
+    : conn_(conn), buf_(init_size, max_size) {
+    pending_consume_ = 0;
+    frame_header_bytes_ = 4;
+    max_frame_size_ = max_size / 2;
+}
+
+void BufferedReader::SetFrameFormat(size_t header_bytes, size_t max_frame_size) {
+    assert(header_bytes == 1 || header_bytes == 2 || header_bytes == 4 || header_bytes == 8);
+    frame_header_bytes_ = header_bytes;
+    max_frame_size_ = max_frame_size;
+}
+
+ReadBuffer &BufferedReader::Buffer() {
+    return buf_;
+}
+
+ssize_t BufferedReader::FillOnce(int64_t expire_at) {
+    int timeout_ms = -1;
+    if (expire_at > 0) {
+        int64_t remain = expire_at - util::NowMs();
+        if (remain <= 0) {
+            LOG_WARNING("buffered read from fd[%d] timeout", conn_.RawFd());
+            return 0;
+        }
+        timeout_ms = (int)remain;
+    }
+    return buf_.Fill(conn_, timeout_ms);
+}
+
+ssize_t BufferedReader::FillAtLeast(size_t n, int64_t expire_at) {
+    while (buf_.Size() < n) {
+        ssize_t ret = FillOnce(expire_at);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+    return buf_.Size();
+}
+
+ssize_t BufferedReader::ReadExact(size_t n, util::Slice &out, int timeout_ms) {
+    if (n == 0) {
+        return -1;
+    }
+    buf_.Consume(pending_consume_);
+    pending_consume_ = 0;
+
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+    ssize_t ret = FillAtLeast(n, expire_at);
+    if (ret <= 0) {
+        return ret;
+    }
+    out = util::Slice(buf_.Data(), n);
+    pending_consume_ = n;
+    return n;
+}
+
+ssize_t BufferedReader::ReadUntil(const char *delim, size_t delim_len, util::Slice &out, int timeout_ms) {
+    if (delim_len == 0) {
+        return -1;
+    }
+    buf_.Consume(pending_consume_);
+    pending_consume_ = 0;
+
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+    // 已经扫描过的位置，新数据到达后从这里继续，避免重复扫描
+    size_t scanned = 0;
+    while (true) {
+        const char *data = buf_.Data();
+        size_t size = buf_.Size();
+        ssize_t found = -1;
+
+        if (delim_len == 2 && delim[0] == '\r' && delim[1] == '\n') {
+            ssize_t pos = util::FindCRLF(data + scanned, size - scanned);
+            if (pos >= 0) {
+                found = scanned + pos;
+            }
+        }
+        else {
+            size_t from = scanned;
+            while (from + delim_len <= size) {
+                const char *p = (const char *)memchr(data + from, delim[0], size - from - delim_len + 1);
+                if (p == nullptr) {
+                    break;
+                }
+                if (memcmp(p, delim, delim_len) == 0) {
+                    found = p - data;
+                    break;
+                }
+                from = p - data + 1;
+            }
+        }
+
+        if (found >= 0) {
+            out = util::Slice(data, found);
+            pending_consume_ = found + delim_len;
+            return pending_consume_;
+        }
+
+        // 分隔符可能跨越两次读取，保留末尾delim_len - 1个字节重新扫描
+        scanned = size >= delim_len ? size - delim_len + 1 : 0;
+        ssize_t ret = FillOnce(expire_at);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+}
+
+ssize_t BufferedReader::ReadFrame(util::Slice &out, int timeout_ms) {
+    buf_.Consume(pending_consume_);
+    pending_consume_ = 0;
+
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+    ssize_t ret = FillAtLeast(frame_header_bytes_, expire_at);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    const unsigned char *header = (const unsigned char *)buf_.Data();
+    uint64_t frame_size = 0;
+    for (size_t i = 0; i < frame_header_bytes_; i++) {
+        frame_size = (frame_size << 8) | header[i];
+    }
+    if (frame_size > max_frame_size_) {
+        LOG_WARNING("frame size %lu from fd[%d] exceeds limit %lu", frame_size, conn_.RawFd(), max_frame_size_);
+        return -1;
+    }
+
+    size_t total = frame_header_bytes_ + frame_size;
+    ret = FillAtLeast(total, expire_at);
+    if (ret <= 0) {
+        return ret;
+    }
+    out = util::Slice(buf_.Data() + frame_header_bytes_, frame_size);
+    pending_consume_ = total;
+    return total;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <inttypes.h>
+
+#include "util.h"
+#include "xsocket.h"
+
+// 线程内的缓冲块池，按2的幂分级缓存，连接关闭后缓冲区留给后续连接复用
+class BufferPool {
+public:
+    ~BufferPool();
+
+    // 实际分配的大小通过size返回，至少为MIN_BLOCK_SIZE
+    char *Allocate(size_t &size);
+
+    void Free(char *buf, size_t size);
+
+    static BufferPool *Instance() {
+        static thread_local BufferPool pool;
+        return &pool;
+    }
+
+    static const size_t MIN_BLOCK_SIZE = 4 * 1024;
+
+    // 超过该大小的块不缓存，直接还给系统
+    static const size_t MAX_POOLED_SIZE = 1024 * 1024;
+
+    static const size_t MAX_BLOCKS_PER_CLASS = 64;
+
+private:
+    static int SizeClass(size_t size);
+
+    // free_blocks_[i]缓存大小为MIN_BLOCK_SIZE << i的块
+    std::vector<std::vector<char *>> free_blocks_;
+};
+
+// 可增长的连续读缓冲，[rpos_, wpos_)为未消费数据
+// 空间不足时先把未消费数据挪到头部，仍然不够再翻倍扩容
+class ReadBuffer {
+public:
+    ReadBuffer(size_t init_size = 16 * 1024, size_t max_size = 64 * 1024 * 1024);
+
+    ~ReadBuffer();
+
+    char *Data();
+
+    size_t Size() const;
+
+    void Consume(size_t n);
+
+    void Clear();
+
+    // 从连接读一次追加到尾部，返回读到的字节数；0表示对端关闭或超时，-1表示出错或超过大小上限
+    // 可能移动数据，之前取得的指针和视图全部失效
+    ssize_t Fill(const Connection &conn, int timeout_ms = -1);
+
+private:
+    ReadBuffer(const ReadBuffer &) = delete;
+    ReadBuffer &operator=(const ReadBuffer &) = delete;
+
+    bool Reserve();
+
+    char *buf_;
+
+    size_t cap_;
+
+    size_t init_size_;
+
+    size_t max_size_;
+
+    size_t rpos_;
+
+    size_t wpos_;
+};
+
+// 连接上的带缓冲读取和分帧，尽量一次读入大块数据，在缓冲区上原地解析
+// 返回的视图在下一次调用本对象的读取接口之前有效
+// 返回值>0表示成功，为本次从流中消耗的字节数（含分隔符/长度头）；0表示对端关闭或超时；-1表示出错
+// timeout_ms是整个操作的超时时间，而不是单次read的超时
+class BufferedReader {
+public:
+    BufferedReader(const Connection &conn, size_t init_size = 16 * 1024, size_t max_size = 64 * 1024 * 1024);
+
+    // 读取恰好n个字节，n必须大于0
+    ssize_t ReadExact(size_t n, util::Slice &out, int timeout_ms = -1);
+
+    // 读取到分隔符为止，out不含分隔符
+    ssize_t ReadUntil(const char *delim, size_t delim_len, util::Slice &out, int timeout_ms = -1);
+
+    // 读取一个长度前缀的帧，长度头为header_bytes字节的大端无符号整数，out为帧内容
+    ssize_t ReadFrame(util::Slice &out, int timeout_ms = -1);
+
+    // 设置长度头字节数（1/2/4/8）和帧内容大小上限
+    void SetFrameFormat(size_t header_bytes, size_t max_frame_size);
+
+    ReadBuffer &Buffer();
+
+private:
+    // 确保缓冲区至少有n个字节，返回值同Fill
+    ssize_t FillAtLeast(size_t n, int64_t expire_at);
+
+    ssize_t FillOnce(int64_t expire_at);
+
+    const Connection &conn_;
+
+    ReadBuffer buf_;
+
+    // 上一次返回给调用方的数据，下次读取时才真正消费，保证视图在此之前有效
+    size_t pending_consume_;
+
+    size_t frame_header_bytes_;
+
+    size_t max_frame_size_;
+};
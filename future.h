@@ -0,0 +1,266 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <assert.h>
+
+#include "xfiber.h"
+
+// 同一个XFiber线程内的Future/Promise，等待方挂起一次，结果就绪时由WakeupFiber唤醒
+// 跨线程完成结果请先通过XFiber::Post切回调度线程
+// 每个Future同一时间只能被一个协程等待；T不能是void，可以用bool代替
+
+namespace future_detail {
+
+// 一次等待：需要再完成remaining_个结果才唤醒fiber_
+struct Waiter {
+    Waiter() : fiber_(nullptr), remaining_(0), woken_(false) {}
+
+    void Notify() {
+        if (remaining_ > 0 && --remaining_ == 0 && !woken_) {
+            woken_ = true;
+            XFiber::xfiber()->WakeupFiber(fiber_);
+        }
+    }
+
+    Fiber *fiber_;
+    size_t remaining_;
+    bool woken_;
+};
+
+struct StateBase {
+    StateBase() : ready_(false), cancelled_(false), waiter_(nullptr) {}
+
+    void MarkReady() {
+        assert(!ready_);
+        ready_ = true;
+        if (waiter_ != nullptr) {
+            Waiter *waiter = waiter_;
+            waiter_ = nullptr;
+            waiter->Notify();
+        }
+    }
+
+    bool ready_;
+    bool cancelled_;
+    std::exception_ptr error_;
+    Waiter *waiter_;
+};
+
+template <typename T>
+struct State : public StateBase {
+    std::unique_ptr<T> value_;
+};
+
+// 挂起当前协程直到waiter被通知或超时，timeout_ms<0表示不超时；返回是否被通知唤醒
+inline bool Park(Waiter &waiter, int timeout_ms) {
+    XFiber *xfiber = XFiber::xfiber();
+    waiter.fiber_ = xfiber->CurrFiber();
+    assert(waiter.fiber_ != nullptr);
+    if (timeout_ms > 0) {
+        WaitingEvents events;
+        events.expire_at_ = util::NowMs() + timeout_ms;
+        xfiber->RegisterWaitingEvents(events);
+    }
+    xfiber->SwitchToSched();
+    bool notified = waiter.woken_;
+    // 超时醒来后不再接受通知
+    waiter.woken_ = true;
+    return notified;
+}
+
+}
+
+// 子任务用来检查结果是否已经不再需要，取消是协作式的，由子任务自行决定何时退出
+class CancelToken {
+public:
+    CancelToken(std::shared_ptr<future_detail::StateBase> state) : state_(state) {}
+
+    bool Cancelled() const {
+        return state_->cancelled_;
+    }
+
+private:
+    std::shared_ptr<future_detail::StateBase> state_;
+};
+
+template <typename T>
+class Promise;
+
+template <typename T>
+class Future {
+public:
+    Future() {}
+
+    bool Valid() const {
+        return state_ != nullptr;
+    }
+
+    bool Ready() const {
+        return state_->ready_;
+    }
+
+    // 等待结果就绪，返回是否就绪；timeout_ms为0时只检查不等待
+    bool Wait(int timeout_ms = -1) {
+        if (state_->ready_ || timeout_ms == 0) {
+            return state_->ready_;
+        }
+        assert(state_->waiter_ == nullptr);
+        future_detail::Waiter waiter;
+        waiter.remaining_ = 1;
+        state_->waiter_ = &waiter;
+        future_detail::Park(waiter, timeout_ms);
+        if (state_->waiter_ == &waiter) {
+            state_->waiter_ = nullptr;
+        }
+        return state_->ready_;
+    }
+
+    // 必须在就绪后调用，子任务抛出的异常在这里重新抛出
+    T &Get() {
+        assert(state_->ready_);
+        if (state_->error_) {
+            std::rethrow_exception(state_->error_);
+        }
+        return *state_->value_;
+    }
+
+    // 通知生产方结果已经不再需要
+    void Cancel() {
+        state_->cancelled_ = true;
+    }
+
+    std::shared_ptr<future_detail::State<T>> &SharedState() {
+        return state_;
+    }
+
+private:
+    friend class Promise<T>;
+
+    Future(std::shared_ptr<future_detail::State<T>> state) : state_(state) {}
+
+    std::shared_ptr<future_detail::State<T>> state_;
+};
+
+template <typename T>
+class Promise {
+public:
+    Promise() : state_(new future_detail::State<T>()) {}
+
+    Future<T> GetFuture() const {
+        return Future<T>(state_);
+    }
+
+    void SetValue(T value) {
+        state_->value_.reset(new T(std::move(value)));
+        state_->MarkReady();
+    }
+
+    void SetException(std::exception_ptr error) {
+        state_->error_ = error;
+        state_->MarkReady();
+    }
+
+    bool Cancelled() const {
+        return state_->cancelled_;
+    }
+
+    CancelToken Token() const {
+        return CancelToken(state_);
+    }
+
+private:
+    std::shared_ptr<future_detail::State<T>> state_;
+};
+
+// 在新协程中执行fn(token)，返回其结果的Future；fn应在合适的位置检查token.Cancelled()
+template <typename F>
+auto Async(F fn, size_t stack_size = 0, std::string fiber_name = "async")
+    -> Future<decltype(fn(std::declval<const CancelToken &>()))> {
+    typedef decltype(fn(std::declval<const CancelToken &>())) T;
+    Promise<T> promise;
+    Future<T> future = promise.GetFuture();
+    XFiber::xfiber()->CreateFiber([promise, fn]() mutable {
+        CancelToken token = promise.Token();
+        if (token.Cancelled()) {
+            promise.SetException(std::make_exception_ptr(std::runtime_error("cancelled before start")));
+            return;
+        }
+        try {
+            promise.SetValue(fn(token));
+        }
+        catch (...) {
+            promise.SetException(std::current_exception());
+        }
+    }, stack_size, fiber_name);
+    return future;
+}
+
+// 等待至少n个Future就绪或者超时，返回时把仍未就绪的Future全部取消
+// 返回已就绪的个数，>=n表示成功；异常结束的Future也算就绪
+template <typename T>
+size_t WhenN(std::vector<Future<T>> &futures, size_t n, int timeout_ms = -1) {
+    size_t ready = 0;
+    for (size_t i = 0; i < futures.size(); i++) {
+        if (futures[i].Ready()) {
+            ready++;
+        }
+    }
+
+    if (ready < n && n <= futures.size() && timeout_ms != 0) {
+        future_detail::Waiter waiter;
+        waiter.remaining_ = n - ready;
+        for (size_t i = 0; i < futures.size(); i++) {
+            future_detail::State<T> *state = futures[i].SharedState().get();
+            if (!state->ready_) {
+                assert(state->waiter_ == nullptr);
+                state->waiter_ = &waiter;
+            }
+        }
+
+        future_detail::Park(waiter, timeout_ms);
+
+        ready = 0;
+        for (size_t i = 0; i < futures.size(); i++) {
+            future_detail::State<T> *state = futures[i].SharedState().get();
+            if (state->waiter_ == &waiter) {
+                state->waiter_ = nullptr;
+            }
+            if (state->ready_) {
+                ready++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < futures.size(); i++) {
+        if (!futures[i].Ready()) {
+            futures[i].Cancel();
+        }
+    }
+    return ready;
+}
+
+// 全部就绪返回true，超时返回false
+template <typename T>
+bool WhenAll(std::vector<Future<T>> &futures, int timeout_ms = -1) {
+    return WhenN(futures, futures.size(), timeout_ms) == futures.size();
+}
+
+// 返回第一个就绪的Future下标，超时返回-1
+template <typename T>
+int WhenAny(std::vector<Future<T>> &futures, int timeout_ms = -1) {
+    if (WhenN(futures, 1, timeout_ms) == 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < futures.size(); i++) {
+        if (futures[i].Ready()) {
+            return i;
+        }
+    }
+    return -1;
+}
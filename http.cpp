@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <errno.h>
+#include <cstring>
+#include "http.h"
+#include "xfiber.h"
+
+
+const util::Slice *HttpRequest::Header(const char *name) const {
+    for (size_t i = 0; i < headers_.size(); i++) {
+        if (headers_[i].name_.EqualsIgnoreCase(name)) {
+            return &headers_[i].value_;
+        }
+    }
+    return nullptr;
+}
+
+// 取一行，行尾允许\r\n或单独的\n；行内出现其它控制字符视为非法请求
+static inline HttpStatus ReadLine(const char *buf, size_t len, size_t &pos, util::Slice &line) {
+    ssize_t ctl = util::FindCtl(buf + pos, len - pos);
+    if (ctl < 0) {
+        return HTTP_INCOMPLETE;
+    }
+    size_t end = pos + ctl;
+    if (buf[end] == '\r') {
+        if (end + 1 >= len) {
+            return HTTP_INCOMPLETE;
+        }
+        if (buf[end + 1] != '\n') {
+            return HTTP_BAD_REQUEST;
+        }
+        line = util::Slice(buf + pos, end - pos);
+        pos = end + 2;
+        return HTTP_OK;
+    }
+    if (buf[end] == '\n') {
+        line = util::Slice(buf + pos, end - pos);
+        pos = end + 1;
+        return HTTP_OK;
+    }
+    return HTTP_BAD_REQUEST;
+}
+
+static inline bool IsTokenChar(unsigned char c) {
+    // RFC 7230 tchar
+    static const char *specials = "\"(),/:;<=>?@[\\]{}";
+    return c > 0x20 && c < 0x7f && strchr(specials, c) == nullptr;
+}
+
+static inline util::Slice Trim(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    return util::Slice(p, end - p);
+}
+
+// 逗号分隔的列表中是否包含token，例如Connection: keep-alive, Upgrade
+static bool ListContains(const util::Slice &value, const char *token) {
+    const char *p = value.Data();
+    const char *end = p + value.Size();
+    while (p < end) {
+        const char *comma = (const char *)memchr(p, ',', end - p);
+        const char *item_end = comma == nullptr ? end : comma;
+        if (Trim(p, item_end).EqualsIgnoreCase(token)) {
+            return true;
+        }
+        p = item_end + 1;
+    }
+    return false;
+}
+
+static HttpStatus ParseRequestLine(const util::Slice &line, HttpRequest &req) {
+    const char *p = line.Data();
+    const char *end = p + line.Size();
+
+    const char *start = p;
+    while (p < end && IsTokenChar(*p)) {
+        p++;
+    }
+    if (p == start || p == end || *p != ' ') {
+        return HTTP_BAD_REQUEST;
+    }
+    req.method_ = util::Slice(start, p - start);
+
+    start = ++p;
+    p = (const char *)memchr(p, ' ', end - p);
+    if (p == nullptr || p == start) {
+        return HTTP_BAD_REQUEST;
+    }
+    req.target_ = util::Slice(start, p - start);
+
+    p++;
+    if (end - p != 8 || memcmp(p, "HTTP/1.", 7) != 0 || p[7] < '0' || p[7] > '9') {
+        return HTTP_BAD_REQUEST;
+    }
+    req.minor_version_ = p[7] - '0';
+    return HTTP_OK;
+}
+
+HttpStatus HttpParser::ParseHeaders(const char *buf, size_t len, HttpRequest &req, size_t *header_len) {
+    req.Reset();
+    size_t pos = 0;
+    util::Slice line;
+    HttpStatus status;
+
+    // 忽略请求之间多余的空行
+    do {
+        if ((status = ReadLine(buf, len, pos, line)) != HTTP_OK) {
+            return status;
+        }
+    } while (line.Empty());
+
+    if ((status = ParseRequestLine(line, req)) != HTTP_OK) {
+        return status;
+    }
+    req.keep_alive_ = req.minor_version_ >= 1;
+
+    while (true) {
+        if ((status = ReadLine(buf, len, pos, line)) != HTTP_OK) {
+            return status;
+        }
+        if (line.Empty()) {
+            break;
+        }
+        if (req.headers_.size() >= MAX_HEADERS) {
+            return HTTP_BAD_REQUEST;
+        }
+
+        const char *p = line.Data();
+        const char *end = p + line.Size();
+        const char *colon = p;
+        while (colon < end && IsTokenChar(*colon)) {
+            colon++;
+        }
+        // 名字为空、名字后有空白或者obs-fold续行都不接受
+        if (colon == p || colon == end || *colon != ':') {
+            return HTTP_BAD_REQUEST;
+        }
+
+        HttpHeader header;
+        header.name_ = util::Slice(p, colon - p);
+        header.value_ = Trim(colon + 1, end);
+        req.headers_.push_back(header);
+
+        if (header.name_.EqualsIgnoreCase("Content-Length")) {
+            int64_t content_length = 0;
+            if (!util::ParseInt64(header.value_.Data(), header.value_.Size(), &content_length) || content_length < 0) {
+                return HTTP_BAD_REQUEST;
+            }
+            if (req.content_length_ >= 0 && req.content_length_ != content_length) {
+                return HTTP_BAD_REQUEST;
+            }
+            req.content_length_ = content_length;
+        }
+        else if (header.name_.EqualsIgnoreCase("Transfer-Encoding")) {
+            if (!ListContains(header.value_, "chunked")) {
+                return HTTP_BAD_REQUEST;
+            }
+            req.chunked_ = true;
+        }
+        else if (header.name_.EqualsIgnoreCase("Connection")) {
+            if (ListContains(header.value_, "close")) {
+                req.keep_alive_ = false;
+            }
+            else if (ListContains(header.value_, "keep-alive")) {
+                req.keep_alive_ = true;
+            }
+        }
+    }
+
+    // 同时出现两种长度声明是请求走私的典型手法，直接拒绝
+    if (req.chunked_ && req.content_length_ >= 0) {
+        return HTTP_BAD_REQUEST;
+    }
+
+    *header_len = pos;
+    return HTTP_OK;
+}
+
+
+HttpChunkedDecoder::HttpChunkedDecoder() {
+    Reset();
+}
+
+void HttpChunkedDecoder::Reset() {
+    state_ = CHUNK_SIZE;
+    raw_pos_ = 0;
+    decoded_ = 0;
+    remain_ = 0;
+}
+
+size_t HttpChunkedDecoder::Decoded() const {
+    return decoded_;
+}
+
+size_t HttpChunkedDecoder::RawConsumed() const {
+    return raw_pos_;
+}
+
+HttpStatus HttpChunkedDecoder::Decode(char *body, size_t len) {
+    while (true) {
+        switch (state_) {
+            case CHUNK_SIZE: {
+                ssize_t crlf = util::FindCRLF(body + raw_pos_, len - raw_pos_);
+                if (crlf < 0) {
+                    return HTTP_INCOMPLETE;
+                }
+                const char *p = body + raw_pos_;
+                const char *end = p + crlf;
+                int64_t size = 0;
+                int digits = 0;
+                for (; p < end; p++, digits++) {
+                    int v;
+                    if (*p >= '0' && *p <= '9') {
+                        v = *p - '0';
+                    }
+                    else if (*p >= 'a' && *p <= 'f') {
+                        v = *p - 'a' + 10;
+                    }
+                    else if (*p >= 'A' && *p <= 'F') {
+                        v = *p - 'A' + 10;
+                    }
+                    else {
+                        break;
+                    }
+                    size = size * 16 + v;
+                    if (size > MAX_CHUNK_SIZE) {
+                        return HTTP_BAD_REQUEST;
+                    }
+                }
+                // 数字后面只允许空白或者chunk扩展
+                if (digits == 0 || (p < end && *p != ';' && *p != ' ' && *p != '\t')) {
+                    return HTTP_BAD_REQUEST;
+                }
+                raw_pos_ += crlf + 2;
+                if (size == 0) {
+                    state_ = CHUNK_TRAILER;
+                }
+                else {
+                    remain_ = size;
+                    state_ = CHUNK_DATA;
+                }
+                break;
+            }
+
+            case CHUNK_DATA: {
+                size_t n = len - raw_pos_;
+                if (n > remain_) {
+                    n = remain_;
+                }
+                if (decoded_ != raw_pos_) {
+                    memmove(body + decoded_, body + raw_pos_, n);
+                }
+                decoded_ += n;
+                raw_pos_ += n;
+                remain_ -= n;
+                if (remain_ > 0) {
+                    return HTTP_INCOMPLETE;
+                }
+                state_ = CHUNK_DATA_CRLF;
+                break;
+            }
+
+            case CHUNK_DATA_CRLF:
+                if (len - raw_pos_ < 2) {
+                    return HTTP_INCOMPLETE;
+                }
+                if (body[raw_pos_] != '\r' || body[raw_pos_ + 1] != '\n') {
+                    return HTTP_BAD_REQUEST;
+                }
+                raw_pos_ += 2;
+                state_ = CHUNK_SIZE;
+                break;
+
+            case CHUNK_TRAILER: {
+                // trailer头部直接丢弃，读到空行结束
+                ssize_t crlf = util::FindCRLF(body + raw_pos_, len - raw_pos_);
+                if (crlf < 0) {
+                    return HTTP_INCOMPLETE;
+                }
+                raw_pos_ += crlf + 2;
+                if (crlf == 0) {
+                    state_ = CHUNK_DONE;
+                    return HTTP_OK;
+                }
+                break;
+            }
+
+            case CHUNK_DONE:
+                return HTTP_OK;
+        }
+    }
+}
+
+
+static const char *ReasonPhrase(int code) {
+    switch (code) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Unknown";
+    }
+}
+
+HttpResponse::HttpResponse() {
+    Reset();
+}
+
+void HttpResponse::Reset() {
+    code_ = 200;
+    reason_.clear();
+    headers_.clear();
+    body_.clear();
+}
+
+void HttpResponse::SetStatus(int code, const char *reason) {
+    code_ = code;
+    if (reason != nullptr) {
+        reason_ = reason;
+    }
+    else {
+        reason_.clear();
+    }
+}
+
+void HttpResponse::AddHeader(const char *name, const char *value) {
+    headers_.append(name);
+    headers_.append(": ", 2);
+    headers_.append(value);
+    headers_.append("\r\n", 2);
+}
+
+void HttpResponse::SetBody(const char *buf, size_t sz) {
+    body_.assign(buf, sz);
+}
+
+void HttpResponse::SetBody(const std::string &body) {
+    body_ = body;
+}
+
+std::string &HttpResponse::Body() {
+    return body_;
+}
+
+int HttpResponse::Code() const {
+    return code_;
+}
+
+void HttpResponse::SerializeTo(std::string &out, int minor_version, bool keep_alive, bool head_request) const {
+    char tmp[128];
+    int n = snprintf(tmp, sizeof(tmp), "HTTP/1.%d %d %s\r\n", minor_version >= 1 ? 1 : 0, code_,
+                     reason_.empty() ? ReasonPhrase(code_) : reason_.c_str());
+    out.append(tmp, n);
+    out.append(headers_);
+
+    bool no_body = (code_ >= 100 && code_ < 200) || code_ == 204 || code_ == 304;
+    if (!no_body) {
+        n = snprintf(tmp, sizeof(tmp), "Content-Length: %lu\r\n", body_.size());
+        out.append(tmp, n);
+    }
+    if (!keep_alive) {
+        out.append("Connection: close\r\n");
+    }
+    else if (minor_version == 0) {
+        out.append("Connection: keep-alive\r\n");
+    }
+    out.append("\r\n", 2);
+    // 多写的body会被流水线上的客户端当成下一个响应的开头
+    if (!no_body && !head_request) {
+        out.append(body_);
+    }
+}
+
+
+HttpSession::HttpSession(std::shared_ptr<Connection> conn, const HttpHandler &handler)
+    : buf_(16 * 1024, MAX_HEADER_SIZE + MAX_BODY_SIZE * 2) {
+    conn_ = conn;
+    handler_ = handler;
+    read_timeout_ms_ = -1;
+    write_timeout_ms_ = -1;
+    pending_consume_ = 0;
+    error_code_ = 0;
+    closing_ = false;
+}
+
+void HttpSession::SetTimeout(int read_timeout_ms, int write_timeout_ms) {
+    read_timeout_ms_ = read_timeout_ms;
+    write_timeout_ms_ = write_timeout_ms;
+}
+
+void HttpSession::SetOverloadHandler(const HttpHandler &handler) {
+    overload_handler_ = handler;
+}
+
+static void DefaultOverloadHandler(const HttpRequest &req, HttpResponse &rsp) {
+    rsp.SetStatus(503);
+    rsp.AddHeader("Retry-After", "1");
+}
+
+HttpStatus HttpSession::ParseRequest() {
+    char *data = buf_.Data();
+    size_t avail = buf_.Size();
+    size_t header_len = 0;
+
+    HttpStatus status = HttpParser::ParseHeaders(data, avail, req_, &header_len);
+    if (status == HTTP_INCOMPLETE) {
+        if (avail > MAX_HEADER_SIZE) {
+            error_code_ = 431;
+            return HTTP_BAD_REQUEST;
+        }
+        return status;
+    }
+    if (status == HTTP_BAD_REQUEST) {
+        error_code_ = 400;
+        return status;
+    }
+
+    size_t total = 0;
+    if (req_.chunked_) {
+        status = chunked_decoder_.Decode(data + header_len, avail - header_len);
+        if (status == HTTP_BAD_REQUEST) {
+            error_code_ = 400;
+            return status;
+        }
+        if (chunked_decoder_.Decoded() > MAX_BODY_SIZE || chunked_decoder_.RawConsumed() > MAX_BODY_SIZE * 2) {
+            error_code_ = 413;
+            return HTTP_BAD_REQUEST;
+        }
+        if (status == HTTP_INCOMPLETE) {
+            return status;
+        }
+        req_.body_ = util::Slice(data + header_len, chunked_decoder_.Decoded());
+        total = header_len + chunked_decoder_.RawConsumed();
+        chunked_decoder_.Reset();
+    }
+    else if (req_.content_length_ > 0) {
+        if ((size_t)req_.content_length_ > MAX_BODY_SIZE) {
+            error_code_ = 413;
+            return HTTP_BAD_REQUEST;
+        }
+        if (avail - header_len < (size_t)req_.content_length_) {
+            return HTTP_INCOMPLETE;
+        }
+        req_.body_ = util::Slice(data + header_len, req_.content_length_);
+        total = header_len + req_.content_length_;
+    }
+    else {
+        total = header_len;
+    }
+
+    pending_consume_ = total;
+    return HTTP_OK;
+}
+
+void HttpSession::WriteError(int code) {
+    rsp_.Reset();
+    rsp_.SetStatus(code);
+    rsp_.SerializeTo(out_, 1, false);
+}
+
+bool HttpSession::Flush() {
+    if (out_.empty()) {
+        return true;
+    }
+    ssize_t n = conn_->Write(out_.data(), out_.size(), write_timeout_ms_);
+    out_.clear();
+    return n > 0;
+}
+
+void HttpSession::Run() {
+    while (true) {
+        // 把缓冲区中已经完整的流水线请求全部处理掉
+        while (!closing_) {
+            HttpStatus status = ParseRequest();
+            if (status == HTTP_INCOMPLETE) {
+                break;
+            }
+            if (status == HTTP_BAD_REQUEST) {
+                LOG_WARNING("bad http request on fd[%d], reply %d and close", conn_->RawFd(), error_code_);
+                WriteError(error_code_);
+                closing_ = true;
+                break;
+            }
+
+            rsp_.Reset();
+            if (XFiber::xfiber()->ShouldShed()) {
+                // 请求已经排队太久，客户端大概率已经超时，快速拒绝以免继续占用资源
+                if (overload_handler_) {
+                    overload_handler_(req_, rsp_);
+                }
+                else {
+                    DefaultOverloadHandler(req_, rsp_);
+                }
+            }
+            else {
+                handler_(req_, rsp_);
+            }
+            rsp_.SerializeTo(out_, req_.minor_version_, req_.keep_alive_, req_.method_.Equals("HEAD"));
+            buf_.Consume(pending_consume_);
+            pending_consume_ = 0;
+            if (!req_.keep_alive_) {
+                closing_ = true;
+            }
+        }
+
+        // 响应合并成一次写
+        if (!Flush() || closing_) {
+            return;
+        }
+
+        ssize_t n = buf_.Fill(*conn_, read_timeout_ms_);
+        if (n <= 0) {
+            return;
+        }
+    }
+}
+
+
+HttpServer::HttpServer(const HttpHandler &handler) {
+    handler_ = handler;
+    read_timeout_ms_ = -1;
+    write_timeout_ms_ = -1;
+}
+
+void HttpServer::SetTimeout(int read_timeout_ms, int write_timeout_ms) {
+    read_timeout_ms_ = read_timeout_ms;
+    write_timeout_ms_ = write_timeout_ms;
+}
+
+void HttpServer::SetOverloadHandler(const HttpHandler &handler) {
+    overload_handler_ = handler;
+}
+
+void HttpServer::Serve(Listener &listener) {
+    XFiber *xfiber = XFiber::xfiber();
+    while (true) {
+        std::shared_ptr<Connection> conn = listener.Accept();
+        if (!conn->Available()) {
+            continue;
+        }
+
+        HttpHandler handler = handler_;
+        HttpHandler overload_handler = overload_handler_;
+        int read_timeout_ms = read_timeout_ms_;
+        int write_timeout_ms = write_timeout_ms_;
+        xfiber->CreateFiber([conn, handler, overload_handler, read_timeout_ms, write_timeout_ms] {
+            HttpSession session(conn, handler);
+            session.SetTimeout(read_timeout_ms, write_timeout_ms);
+            session.SetOverloadHandler(overload_handler);
+            session.Run();
+        }, 0, "http");
+    }
+}
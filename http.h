@@ -0,0 +1,211 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <inttypes.h>
+
+#include "util.h"
+#include "xsocket.h"
+#include "buffered_reader.h"
+
+typedef enum {
+    HTTP_OK = 0,
+    HTTP_INCOMPLETE = 1,
+    HTTP_BAD_REQUEST = 2
+}HttpStatus;
+
+struct HttpHeader {
+    util::Slice name_;
+    util::Slice value_;
+};
+
+// 解析出的请求，所有字段都是连接读缓冲区上的视图，只在handler调用期间有效
+struct HttpRequest {
+    HttpRequest() {
+        Reset();
+    }
+
+    void Reset() {
+        method_ = util::Slice();
+        target_ = util::Slice();
+        minor_version_ = 1;
+        headers_.clear();
+        body_ = util::Slice();
+        content_length_ = -1;
+        chunked_ = false;
+        keep_alive_ = true;
+    }
+
+    // 按名字查找头部（不区分大小写），找不到返回nullptr
+    const util::Slice *Header(const char *name) const;
+
+    util::Slice method_;
+    util::Slice target_;
+    int minor_version_;
+    std::vector<HttpHeader> headers_;
+    util::Slice body_;
+    int64_t content_length_;
+    bool chunked_;
+    bool keep_alive_;
+};
+
+class HttpParser {
+public:
+    // 解析请求行和头部，header_len返回头部总长度（含结尾空行）
+    static HttpStatus ParseHeaders(const char *buf, size_t len, HttpRequest &req, size_t *header_len);
+
+    static const size_t MAX_HEADERS = 64;
+};
+
+// chunked编码的原地解码器：解码后的数据向前搬到body起始处，保证body连续
+// 偏移都相对于body起始位置，缓冲区搬移后依然有效
+class HttpChunkedDecoder {
+public:
+    HttpChunkedDecoder();
+
+    void Reset();
+
+    // 解码body[0, len)中新到的数据，返回HTTP_OK时body[0, Decoded())即为完整内容
+    HttpStatus Decode(char *body, size_t len);
+
+    size_t Decoded() const;
+
+    // 原始chunked数据（含trailer）占用的字节数
+    size_t RawConsumed() const;
+
+    static const int64_t MAX_CHUNK_SIZE = 64 * 1024 * 1024;
+
+private:
+    typedef enum {
+        CHUNK_SIZE = 0,
+        CHUNK_DATA = 1,
+        CHUNK_DATA_CRLF = 2,
+        CHUNK_TRAILER = 3,
+        CHUNK_DONE = 4
+    }State;
+
+    State state_;
+
+    // 已经处理到的原始数据位置
+    size_t raw_pos_;
+
+    // 解码后数据的结尾
+    size_t decoded_;
+
+    // 当前chunk剩余字节数
+    size_t remain_;
+};
+
+class HttpResponse {
+public:
+    HttpResponse();
+
+    void Reset();
+
+    void SetStatus(int code, const char *reason = nullptr);
+
+    void AddHeader(const char *name, const char *value);
+
+    void SetBody(const char *buf, size_t sz);
+
+    void SetBody(const std::string &body);
+
+    std::string &Body();
+
+    int Code() const;
+
+    // 序列化到out尾部，Content-Length和Connection由这里统一补上
+    // HEAD请求只写头部，Content-Length仍按body计算，handler可以和GET共用；
+    // 1xx/204/304不能带body，也不写Content-Length
+    void SerializeTo(std::string &out, int minor_version, bool keep_alive, bool head_request = false) const;
+
+private:
+    int code_;
+
+    std::string reason_;
+
+    // 已经拼好的"name: value\r\n"块，避免逐个头部分配
+    std::string headers_;
+
+    std::string body_;
+};
+
+typedef std::function<void (const HttpRequest &, HttpResponse &)> HttpHandler;
+
+// 一个连接上的收发循环，读缓冲、请求和响应对象在连接生命周期内复用
+class HttpSession {
+public:
+    HttpSession(std::shared_ptr<Connection> conn, const HttpHandler &handler);
+
+    void SetTimeout(int read_timeout_ms, int write_timeout_ms);
+
+    // 调度过载且请求排队太久时（XFiber::ShouldShed）代替handler生成响应，默认回503
+    void SetOverloadHandler(const HttpHandler &handler);
+
+    // 处理该连接直到对端关闭、超时或出错
+    void Run();
+
+    static const size_t MAX_HEADER_SIZE = 64 * 1024;
+
+    static const size_t MAX_BODY_SIZE = 8 * 1024 * 1024;
+
+private:
+    // 尝试从缓冲区解析一个完整请求，成功返回HTTP_OK，请求占用的字节数记在pending_consume_
+    HttpStatus ParseRequest();
+
+    void WriteError(int code);
+
+    bool Flush();
+
+    std::shared_ptr<Connection> conn_;
+
+    HttpHandler handler_;
+
+    HttpHandler overload_handler_;
+
+    int read_timeout_ms_;
+
+    int write_timeout_ms_;
+
+    ReadBuffer buf_;
+
+    // 已经解析、尚未从缓冲区消费的字节数，handler返回前请求视图必须有效
+    size_t pending_consume_;
+
+    HttpRequest req_;
+
+    HttpResponse rsp_;
+
+    HttpChunkedDecoder chunked_decoder_;
+
+    // 流水线请求的响应先攒起来，读不到完整请求时再统一写出
+    std::string out_;
+
+    // 非法请求时回给客户端的状态码
+    int error_code_;
+
+    bool closing_;
+};
+
+class HttpServer {
+public:
+    HttpServer(const HttpHandler &handler);
+
+    void SetTimeout(int read_timeout_ms, int write_timeout_ms);
+
+    void SetOverloadHandler(const HttpHandler &handler);
+
+    // 在当前协程中循环accept，每个连接创建一个协程处理
+    void Serve(Listener &listener);
+
+private:
+    HttpHandler handler_;
+
+    HttpHandler overload_handler_;
+
+    int read_timeout_ms_;
+
+    int write_timeout_ms_;
+};
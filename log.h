@@ -2,11 +2,21 @@
 
 #include <cstdio>
 #include <string>
+#include <ctime>
 
+// 可以在编译时覆盖，例如 make EXTRA_CFLAGS=-DDEBUG_ENABLE=0
+#ifndef DEBUG_ENABLE
 #define DEBUG_ENABLE    1
+#endif
+#ifndef INFO_ENABLE
 #define INFO_ENABLE     1
+#endif
+#ifndef WARNING_ENABLE
 #define WARNING_ENABLE  1
+#endif
+#ifndef ERROR_ENABLE
 #define ERROR_ENABLE    1
+#endif
 
 
 static std::string log_date() {
@@ -7,6 +7,7 @@
 
 #include "xfiber.h"
 #include "xsocket.h"
+#include "resp.h"
 
 using namespace std;
 
@@ -24,6 +25,12 @@ int main() {
     signal(SIGINT, sigint_action);
 
     XFiber *xfiber = XFiber::xfiber();
+
+    // 连接数上限和5ms的排队延迟目标，过载时暂停accept并快速拒绝排队太久的请求
+    OverloadConfig overload_config;
+    overload_config.max_connections_ = 10000;
+    overload_config.target_delay_us_ = 5000;
+    xfiber->SetOverloadConfig(overload_config);
     /*xfiber->AddTask([&]() {
         cout << "hello world 11" << endl;
         xfiber->Yield();
@@ -54,25 +61,33 @@ int main() {
             shared_ptr<Connection> conn1 = listener.Accept();
             //shared_ptr<Connection> conn2 = Connection::ConnectTCP("127.0.0.1", 6379);
 
-            xfiber->CreateFiber([conn1] {
+            xfiber->CreateFiber([xfiber, conn1] {
+                RespCodec codec;
                 while (true) {
-                    char recv_buf[512];
-                    int n = conn1->Read(recv_buf, 512, 50000);
+                    ssize_t n = codec.ReadCommands(*conn1, 50000);
                     if (n <= 0) {
                         break;
                     }
 
-                 #if 0
-                    conn2->Write(recv_buf, n);
-                    char rsp[1024];
-                    int rsp_len = conn2->Read(rsp, 1024);
-                    cout << "recv from remote: " << rsp << endl;
-                    conn1->Write(rsp, rsp_len);
-                #else
-                    if (conn1->Write("+OK\r\n", 5, 1000) <= 0) {
+                    // 一次读到的流水线命令全部处理完后合并成一次写
+                    RespWriter &writer = codec.Writer();
+                    bool shed = xfiber->ShouldShed();
+                    for (ssize_t i = 0; i < n; i++) {
+                        if (shed) {
+                            writer.AppendError("BUSY server is overloaded, try again later");
+                            continue;
+                        }
+                        const RespCommand &cmd = codec.Command(i);
+                        if (cmd.args_[0].EqualsIgnoreCase("PING")) {
+                            writer.AppendSimpleString("PONG");
+                        }
+                        else {
+                            writer.AppendSimpleString("OK");
+                        }
+                    }
+                    if (codec.Flush(*conn1, 1000) <= 0) {
                         break;
                     }
-                #endif
                 }
             }, 0, "server");
         }
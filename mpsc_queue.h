@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// 多生产者单消费者无锁队列（Vyukov算法）
+// Push可以在任意线程调用，wait-free；Pop只能在唯一的消费者线程调用
+// 生产者交换head_之后、链接next_之前，消费者会短暂看到队列为空，
+// 因此Pop返回false不代表队列一定为空，调用方需要在下一轮继续消费
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() {
+        Node *stub = new Node();
+        head_.store(stub, std::memory_order_relaxed);
+        tail_ = stub;
+    }
+
+    ~MpscQueue() {
+        T value;
+        while (Pop(value)) {
+        }
+        delete tail_;
+    }
+
+    void Push(T value) {
+        Node *node = new Node();
+        node->value_ = std::move(value);
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next_.store(node, std::memory_order_release);
+    }
+
+    bool Pop(T &value) {
+        Node *tail = tail_;
+        Node *next = tail->next_.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        value = std::move(next->value_);
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+    bool Empty() const {
+        return tail_->next_.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    struct Node {
+        Node() : next_(nullptr) {}
+        std::atomic<Node *> next_;
+        T value_;
+    };
+
+    // 生产者端
+    std::atomic<Node *> head_;
+
+    // 消费者端，指向已经消费过的哨兵节点
+    Node *tail_;
+};
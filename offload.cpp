@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <cstring>
+#include <unistd.h>
+#include "offload.h"
+
+
+OffloadPool::OffloadPool(size_t thread_count, size_t max_pending) {
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+        if (thread_count == 0) {
+            thread_count = 4;
+        }
+    }
+    max_pending_ = max_pending;
+    stopped_ = false;
+    for (size_t i = 0; i < thread_count; i++) {
+        workers_.push_back(std::thread(&OffloadPool::WorkerLoop, this));
+    }
+    LOG_INFO("offload pool started with %lu thread(s)", thread_count);
+}
+
+OffloadPool::~OffloadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    cond_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i].join();
+    }
+}
+
+OffloadPool *OffloadPool::Instance() {
+    static OffloadPool pool;
+    return &pool;
+}
+
+bool OffloadPool::Submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_ || jobs_.size() >= max_pending_) {
+            return false;
+        }
+        jobs_.push_back(std::move(job));
+    }
+    cond_.notify_one();
+    return true;
+}
+
+size_t OffloadPool::Pending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.size();
+}
+
+void OffloadPool::WorkerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopped_ && jobs_.empty()) {
+                cond_.wait(lock);
+            }
+            // 退出前把已经提交的任务执行完，否则挂起的协程永远不会被唤醒
+            if (jobs_.empty()) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+    }
+}
+
+
+namespace offload {
+
+ssize_t ReadFile(const std::string &path, std::string &content) {
+    int err = 0;
+    ssize_t ret = Offload([&path, &content, &err]() -> ssize_t {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            err = errno;
+            return -1;
+        }
+        content.clear();
+        char buf[64 * 1024];
+        while (true) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n > 0) {
+                content.append(buf, n);
+            }
+            else if (n == 0) {
+                break;
+            }
+            else if (errno != EINTR) {
+                err = errno;
+                close(fd);
+                return -1;
+            }
+        }
+        close(fd);
+        return content.size();
+    });
+    // errno是线程局部的，需要在协程所在线程重新设置
+    if (ret < 0) {
+        errno = err;
+    }
+    return ret;
+}
+
+ssize_t WriteFile(const std::string &path, const char *buf, size_t sz, bool append) {
+    int err = 0;
+    ssize_t ret = Offload([&path, buf, sz, append, &err]() -> ssize_t {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(path.c_str(), flags, 0644);
+        if (fd < 0) {
+            err = errno;
+            return -1;
+        }
+        size_t written = 0;
+        while (written < sz) {
+            ssize_t n = write(fd, buf + written, sz - written);
+            if (n > 0) {
+                written += n;
+            }
+            else if (n < 0 && errno != EINTR) {
+                err = errno;
+                close(fd);
+                return -1;
+            }
+        }
+        close(fd);
+        return written;
+    });
+    if (ret < 0) {
+        errno = err;
+    }
+    return ret;
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include <assert.h>
+
+#include "xfiber.h"
+
+// 阻塞调用（文件IO、getaddrinfo、压缩、加解密等）的线程池
+// 线程数和排队任务数都有上限，协程通过Offload把任务丢进来并挂起，完成后回到原调度线程继续执行
+class OffloadPool {
+public:
+    OffloadPool(size_t thread_count = 0, size_t max_pending = 65536);
+
+    ~OffloadPool();
+
+    // 队列满时返回false，不阻塞调用线程
+    bool Submit(std::function<void()> job);
+
+    size_t Pending();
+
+    // 进程级默认线程池，第一次使用时创建
+    static OffloadPool *Instance();
+
+private:
+    void WorkerLoop();
+
+    size_t max_pending_;
+
+    bool stopped_;
+
+    std::mutex mutex_;
+
+    std::condition_variable cond_;
+
+    std::deque<std::function<void()>> jobs_;
+
+    std::vector<std::thread> workers_;
+};
+
+namespace offload_detail {
+
+// 保存结果或者异常，void单独特化
+template <typename T>
+struct Result {
+    std::unique_ptr<T> value_;
+    std::exception_ptr error_;
+
+    template <typename F>
+    void Run(F &fn) {
+        try {
+            value_.reset(new T(fn()));
+        }
+        catch (...) {
+            error_ = std::current_exception();
+        }
+    }
+
+    T Get() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*value_);
+    }
+};
+
+template <>
+struct Result<void> {
+    std::exception_ptr error_;
+
+    template <typename F>
+    void Run(F &fn) {
+        try {
+            fn();
+        }
+        catch (...) {
+            error_ = std::current_exception();
+        }
+    }
+
+    void Get() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+};
+
+}
+
+// 在线程池中执行fn，当前协程挂起直到fn完成，fn抛出的异常在协程中重新抛出
+// 只能在协程中调用；结果保存在协程栈上，协程挂起期间栈一直有效
+template <typename F>
+auto Offload(F fn, OffloadPool *pool = nullptr) -> decltype(fn()) {
+    typedef decltype(fn()) R;
+    XFiber *xfiber = XFiber::xfiber();
+    Fiber *fiber = xfiber->CurrFiber();
+    assert(fiber != nullptr);
+    if (pool == nullptr) {
+        pool = OffloadPool::Instance();
+    }
+
+    offload_detail::Result<R> result;
+    std::function<void()> job = [&fn, &result, xfiber, fiber] {
+        result.Run(fn);
+        xfiber->RemoteWakeup(fiber);
+    };
+    // 队列满时退避等待，不阻塞调度线程
+    while (!pool->Submit(job)) {
+        xfiber->SleepMs(1);
+    }
+    xfiber->SwitchToSched();
+    return result.Get();
+}
+
+namespace offload {
+
+// 读取整个文件到content，返回读取的字节数，失败返回-1并设置errno
+ssize_t ReadFile(const std::string &path, std::string &content);
+
+// 写文件，append为false时覆盖原文件，返回写入的字节数，失败返回-1并设置errno
+ssize_t WriteFile(const std::string &path, const char *buf, size_t sz, bool append = false);
+
+}
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <errno.h>
+#include <cstring>
+#include "resp.h"
+#include "xfiber.h"
+
+
+// 从pos开始取一行，line不含\r\n，成功后pos指向下一行；行长超过MAX_INLINE_LEN为协议错误
+static inline RespStatus ReadLine(const char *buf, size_t len, size_t &pos, util::Slice &line) {
+    ssize_t crlf = util::FindCRLF(buf + pos, len - pos);
+    if (crlf < 0) {
+        return len - pos > RespParser::MAX_INLINE_LEN ? RESP_PROTOCOL_ERROR : RESP_INCOMPLETE;
+    }
+    if ((size_t)crlf > RespParser::MAX_INLINE_LEN) {
+        return RESP_PROTOCOL_ERROR;
+    }
+    line = util::Slice(buf + pos, crlf);
+    pos += crlf + 2;
+    return RESP_OK;
+}
+
+// 读取"<len>\r\n<payload>\r\n"形式的定长内容，payload按长度直接跳过而不扫描
+static inline RespStatus ReadBulk(const char *buf, size_t len, size_t &pos, RespNode &node) {
+    util::Slice line;
+    RespStatus status = ReadLine(buf, len, pos, line);
+    if (status != RESP_OK) {
+        return status;
+    }
+    int64_t bulk_len = 0;
+    if (!util::ParseInt64(line.Data(), line.Size(), &bulk_len) || bulk_len < -1 || bulk_len > RespParser::MAX_BULK_LEN) {
+        return RESP_PROTOCOL_ERROR;
+    }
+    if (bulk_len == -1) {
+        node.null_ = true;
+        return RESP_OK;
+    }
+    if (len - pos < (size_t)bulk_len + 2) {
+        return RESP_INCOMPLETE;
+    }
+    if (buf[pos + bulk_len] != '\r' || buf[pos + bulk_len + 1] != '\n') {
+        return RESP_PROTOCOL_ERROR;
+    }
+    node.str_ = util::Slice(buf + pos, bulk_len);
+    pos += bulk_len + 2;
+    return RESP_OK;
+}
+
+RespStatus RespParser::Parse(const char *buf, size_t len, std::vector<RespNode> &nodes, size_t *consumed) {
+    size_t pos = 0;
+    size_t origin = nodes.size();
+    RespStatus status = ParseValue(buf, len, pos, nodes, 0);
+    if (status != RESP_OK) {
+        // 不完整时丢弃已追加的节点，等数据到齐后重新解析
+        nodes.resize(origin);
+        return status;
+    }
+    *consumed = pos;
+    return RESP_OK;
+}
+
+RespStatus RespParser::ParseValue(const char *buf, size_t len, size_t &pos, std::vector<RespNode> &nodes, int depth) {
+    if (depth > MAX_NESTING) {
+        return RESP_PROTOCOL_ERROR;
+    }
+    if (pos >= len) {
+        return RESP_INCOMPLETE;
+    }
+
+    RespNode node;
+    node.type_ = (RespType)buf[pos++];
+    node.integer_ = 0;
+    node.null_ = false;
+
+    util::Slice line;
+    RespStatus status;
+    switch (node.type_) {
+        case RESP_SIMPLE_STRING:
+        case RESP_ERROR:
+        case RESP_DOUBLE:
+        case RESP_BIG_NUMBER:
+            if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+                return status;
+            }
+            node.str_ = line;
+            nodes.push_back(node);
+            return RESP_OK;
+
+        case RESP_INTEGER:
+            if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+                return status;
+            }
+            if (!util::ParseInt64(line.Data(), line.Size(), &node.integer_)) {
+                return RESP_PROTOCOL_ERROR;
+            }
+            node.str_ = line;
+            nodes.push_back(node);
+            return RESP_OK;
+
+        case RESP_NULL:
+            if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+                return status;
+            }
+            if (!line.Empty()) {
+                return RESP_PROTOCOL_ERROR;
+            }
+            node.null_ = true;
+            nodes.push_back(node);
+            return RESP_OK;
+
+        case RESP_BOOLEAN:
+            if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+                return status;
+            }
+            if (line.Size() != 1 || (line[0] != 't' && line[0] != 'f')) {
+                return RESP_PROTOCOL_ERROR;
+            }
+            node.integer_ = line[0] == 't' ? 1 : 0;
+            nodes.push_back(node);
+            return RESP_OK;
+
+        case RESP_BULK_STRING:
+        case RESP_BULK_ERROR:
+        case RESP_VERBATIM:
+            if ((status = ReadBulk(buf, len, pos, node)) != RESP_OK) {
+                return status;
+            }
+            nodes.push_back(node);
+            return RESP_OK;
+
+        case RESP_ARRAY:
+        case RESP_SET:
+        case RESP_PUSH:
+        case RESP_MAP:
+        case RESP_ATTRIBUTE: {
+            if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+                return status;
+            }
+            int64_t count = 0;
+            if (!util::ParseInt64(line.Data(), line.Size(), &count) || count < -1 || count > MAX_MULTIBULK_LEN) {
+                return RESP_PROTOCOL_ERROR;
+            }
+            if (count == -1) {
+                node.null_ = true;
+                nodes.push_back(node);
+                return RESP_OK;
+            }
+            node.integer_ = count;
+            nodes.push_back(node);
+
+            int64_t children = (node.type_ == RESP_MAP || node.type_ == RESP_ATTRIBUTE) ? count * 2 : count;
+            for (int64_t i = 0; i < children; i++) {
+                if ((status = ParseValue(buf, len, pos, nodes, depth + 1)) != RESP_OK) {
+                    return status;
+                }
+            }
+            return RESP_OK;
+        }
+
+        default:
+            return RESP_PROTOCOL_ERROR;
+    }
+}
+
+RespStatus RespParser::ParseCommand(const char *buf, size_t len, RespCommand &cmd, size_t *consumed) {
+    cmd.args_.clear();
+    size_t pos = 0;
+    util::Slice line;
+    RespStatus status;
+
+    if (len == 0) {
+        return RESP_INCOMPLETE;
+    }
+
+    if (buf[0] != '*') {
+        // inline命令，按空白切分，不支持引号
+        if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+            return status;
+        }
+        const char *p = line.Data();
+        const char *end = p + line.Size();
+        while (p < end) {
+            while (p < end && (*p == ' ' || *p == '\t')) {
+                p++;
+            }
+            const char *start = p;
+            while (p < end && *p != ' ' && *p != '\t') {
+                p++;
+            }
+            if (p > start) {
+                cmd.args_.push_back(util::Slice(start, p - start));
+            }
+        }
+        *consumed = pos;
+        return RESP_OK;
+    }
+
+    pos = 1;
+    if ((status = ReadLine(buf, len, pos, line)) != RESP_OK) {
+        return status;
+    }
+    int64_t count = 0;
+    if (!util::ParseInt64(line.Data(), line.Size(), &count) || count > MAX_MULTIBULK_LEN) {
+        return RESP_PROTOCOL_ERROR;
+    }
+
+    for (int64_t i = 0; i < count; i++) {
+        if (pos >= len) {
+            return RESP_INCOMPLETE;
+        }
+        if (buf[pos] != '$') {
+            return RESP_PROTOCOL_ERROR;
+        }
+        pos++;
+        RespNode node;
+        node.null_ = false;
+        if ((status = ReadBulk(buf, len, pos, node)) != RESP_OK) {
+            return status;
+        }
+        if (node.null_) {
+            return RESP_PROTOCOL_ERROR;
+        }
+        cmd.args_.push_back(node.str_);
+    }
+    *consumed = pos;
+    return RESP_OK;
+}
+
+
+RespWriter::RespWriter(bool resp3) {
+    resp3_ = resp3;
+}
+
+void RespWriter::SetResp3(bool resp3) {
+    resp3_ = resp3;
+}
+
+void RespWriter::AppendLine(char prefix, int64_t v) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%c%" PRId64 "\r\n", prefix, v);
+    out_.append(tmp, n);
+}
+
+void RespWriter::AppendSimpleString(const char *s) {
+    out_.push_back('+');
+    out_.append(s);
+    out_.append("\r\n", 2);
+}
+
+void RespWriter::AppendError(const char *s) {
+    out_.push_back('-');
+    out_.append(s);
+    out_.append("\r\n", 2);
+}
+
+void RespWriter::AppendInteger(int64_t v) {
+    AppendLine(':', v);
+}
+
+void RespWriter::AppendBulkString(const char *buf, size_t sz) {
+    AppendLine('$', (int64_t)sz);
+    out_.append(buf, sz);
+    out_.append("\r\n", 2);
+}
+
+void RespWriter::AppendBulkString(const util::Slice &s) {
+    AppendBulkString(s.Data(), s.Size());
+}
+
+void RespWriter::AppendNull() {
+    if (resp3_) {
+        out_.append("_\r\n", 3);
+    }
+    else {
+        out_.append("$-1\r\n", 5);
+    }
+}
+
+void RespWriter::AppendArrayHeader(size_t n) {
+    AppendLine('*', (int64_t)n);
+}
+
+void RespWriter::AppendMapHeader(size_t n) {
+    if (resp3_) {
+        AppendLine('%', (int64_t)n);
+    }
+    else {
+        AppendLine('*', (int64_t)n * 2);
+    }
+}
+
+void RespWriter::AppendBoolean(bool v) {
+    if (resp3_) {
+        out_.append(v ? "#t\r\n" : "#f\r\n", 4);
+    }
+    else {
+        AppendInteger(v ? 1 : 0);
+    }
+}
+
+void RespWriter::AppendDouble(double v) {
+    char tmp[64];
+    int n = snprintf(tmp, sizeof(tmp), "%.17g", v);
+    if (resp3_) {
+        out_.push_back(',');
+        out_.append(tmp, n);
+        out_.append("\r\n", 2);
+    }
+    else {
+        AppendBulkString(tmp, n);
+    }
+}
+
+void RespWriter::AppendRaw(const char *buf, size_t sz) {
+    out_.append(buf, sz);
+}
+
+bool RespWriter::Empty() const {
+    return out_.empty();
+}
+
+const std::string &RespWriter::Buffer() const {
+    return out_;
+}
+
+void RespWriter::Clear() {
+    out_.clear();
+}
+
+ssize_t RespWriter::Flush(const Connection &conn, int timeout_ms) {
+    if (out_.empty()) {
+        return 0;
+    }
+    ssize_t n = conn.Write(out_.data(), out_.size(), timeout_ms);
+    out_.clear();
+    return n;
+}
+
+
+RespCodec::RespCodec(size_t init_buf_size)
+    : buf_(init_buf_size, (size_t)RespParser::MAX_BULK_LEN * 2) {
+    pending_consume_ = 0;
+}
+
+const RespCommand &RespCodec::Command(size_t i) const {
+    return cmds_[i];
+}
+
+RespWriter &RespCodec::Writer() {
+    return writer_;
+}
+
+ssize_t RespCodec::Flush(const Connection &conn, int timeout_ms) {
+    return writer_.Flush(conn, timeout_ms);
+}
+
+ssize_t RespCodec::ParseCommands() {
+    const char *data = buf_.Data();
+    size_t size = buf_.Size();
+    size_t pos = 0;
+    size_t count = 0;
+    while (pos < size) {
+        if (count == cmds_.size()) {
+            cmds_.push_back(RespCommand());
+        }
+        size_t consumed = 0;
+        RespStatus status = RespParser::ParseCommand(data + pos, size - pos, cmds_[count], &consumed);
+        if (status == RESP_INCOMPLETE) {
+            break;
+        }
+        if (status == RESP_PROTOCOL_ERROR) {
+            LOG_WARNING("parse resp command failed, drop connection");
+            return -1;
+        }
+        pos += consumed;
+        // 空行直接忽略
+        if (!cmds_[count].args_.empty()) {
+            count++;
+        }
+    }
+    pending_consume_ = pos;
+    return count;
+}
+
+ssize_t RespCodec::ReadCommands(const Connection &conn, int timeout_ms) {
+    // 上一批命令已经处理完，释放其占用的数据
+    buf_.Consume(pending_consume_);
+    pending_consume_ = 0;
+
+    while (true) {
+        if (buf_.Size() > 0) {
+            ssize_t count = ParseCommands();
+            if (count != 0) {
+                return count;
+            }
+            // 只有不完整的命令，数据留在缓冲区等待后续读取
+            buf_.Consume(pending_consume_);
+            pending_consume_ = 0;
+        }
+
+        ssize_t n = buf_.Fill(conn, timeout_ms);
+        if (n <= 0) {
+            return n;
+        }
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+#include "util.h"
+#include "xsocket.h"
+#include "buffered_reader.h"
+
+typedef enum {
+    // RESP2
+    RESP_SIMPLE_STRING = '+',
+    RESP_ERROR = '-',
+    RESP_INTEGER = ':',
+    RESP_BULK_STRING = '$',
+    RESP_ARRAY = '*',
+    // RESP3
+    RESP_NULL = '_',
+    RESP_BOOLEAN = '#',
+    RESP_DOUBLE = ',',
+    RESP_BIG_NUMBER = '(',
+    RESP_BULK_ERROR = '!',
+    RESP_VERBATIM = '=',
+    RESP_MAP = '%',
+    RESP_SET = '~',
+    RESP_PUSH = '>',
+    RESP_ATTRIBUTE = '|'
+}RespType;
+
+typedef enum {
+    RESP_OK = 0,
+    RESP_INCOMPLETE = 1,
+    RESP_PROTOCOL_ERROR = 2
+}RespStatus;
+
+// 扁平化的RESP节点，聚合类型的子节点按先序紧跟在后面
+struct RespNode {
+    RespType type_;
+    // 字符串类的内容，直接指向读缓冲区
+    util::Slice str_;
+    // 整数/布尔的值；聚合类型为直接子元素个数（map/attribute为键值对数）
+    int64_t integer_;
+    // RESP2的$-1/*-1以及RESP3的_
+    bool null_;
+};
+
+// 一条客户端命令，参数全部是读缓冲区上的视图
+struct RespCommand {
+    std::vector<util::Slice> args_;
+};
+
+class RespParser {
+public:
+    // 解析buf开头的一个完整值并追加到nodes，consumed返回消耗的字节数
+    static RespStatus Parse(const char *buf, size_t len, std::vector<RespNode> &nodes, size_t *consumed);
+
+    // 解析一条命令：multibulk(*N $len ...)或者inline命令(PING\r\n)
+    static RespStatus ParseCommand(const char *buf, size_t len, RespCommand &cmd, size_t *consumed);
+
+    static const int64_t MAX_BULK_LEN = 512 * 1024 * 1024;
+
+    static const int64_t MAX_MULTIBULK_LEN = 1024 * 1024;
+
+    // 按行读取的内容（inline命令、*N/$N头部、简单字符串等）的最大长度，与redis的PROTO_INLINE_MAX_SIZE一致
+    // 超过后仍找不到\r\n视为协议错误，避免客户端只发数据不发换行把缓冲区撑大
+    static const size_t MAX_INLINE_LEN = 64 * 1024;
+
+    static const int MAX_NESTING = 64;
+
+private:
+    static RespStatus ParseValue(const char *buf, size_t len, size_t &pos, std::vector<RespNode> &nodes, int depth);
+};
+
+// 回复缓冲，一批命令的回复拼在一起，最后一次Write发出
+class RespWriter {
+public:
+    RespWriter(bool resp3 = false);
+
+    void SetResp3(bool resp3);
+
+    void AppendSimpleString(const char *s);
+
+    void AppendError(const char *s);
+
+    void AppendInteger(int64_t v);
+
+    void AppendBulkString(const char *buf, size_t sz);
+
+    void AppendBulkString(const util::Slice &s);
+
+    void AppendNull();
+
+    void AppendArrayHeader(size_t n);
+
+    // RESP2下退化为2n个元素的数组
+    void AppendMapHeader(size_t n);
+
+    void AppendBoolean(bool v);
+
+    void AppendDouble(double v);
+
+    void AppendRaw(const char *buf, size_t sz);
+
+    bool Empty() const;
+
+    const std::string &Buffer() const;
+
+    void Clear();
+
+    // 把积攒的回复一次写出，返回写出的字节数，<=0表示失败
+    ssize_t Flush(const Connection &conn, int timeout_ms = -1);
+
+private:
+    void AppendLine(char prefix, int64_t v);
+
+    bool resp3_;
+
+    std::string out_;
+};
+
+// 连接级的编解码器：持有可增长的读缓冲，一次读取解析出所有流水线命令
+class RespCodec {
+public:
+    RespCodec(size_t init_buf_size = 16 * 1024);
+
+    // 读取并解析缓冲区内全部完整命令，返回命令条数；0表示对端关闭或超时，-1表示出错或协议错误
+    // 返回的命令是读缓冲区上的视图，下一次ReadCommands之前有效
+    ssize_t ReadCommands(const Connection &conn, int timeout_ms = -1);
+
+    const RespCommand &Command(size_t i) const;
+
+    RespWriter &Writer();
+
+    ssize_t Flush(const Connection &conn, int timeout_ms = -1);
+
+private:
+    ssize_t ParseCommands();
+
+    ReadBuffer buf_;
+
+    // 上一批命令占用的字节数，下次读取时才消费，保证命令视图在此之前有效
+    size_t pending_consume_;
+
+    // 复用RespCommand对象，避免每批重新分配参数数组
+    std::vector<RespCommand> cmds_;
+
+    RespWriter writer_;
+};
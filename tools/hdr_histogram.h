@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <inttypes.h>
+
+// HdrHistogram的精简实现：对数分桶+桶内线性子桶，在[1, highest]范围内保持指定的有效数字精度
+// 记录是O(1)的数组自增，可以在压测热路径上使用
+class HdrHistogram {
+public:
+    HdrHistogram(int64_t highest = 3600LL * 1000 * 1000, int significant_figures = 3) {
+        int64_t largest_single_unit = 2;
+        for (int i = 0; i < significant_figures; i++) {
+            largest_single_unit *= 10;
+        }
+        sub_bucket_count_magnitude_ = 0;
+        while ((1LL << sub_bucket_count_magnitude_) < largest_single_unit) {
+            sub_bucket_count_magnitude_++;
+        }
+        sub_bucket_half_count_magnitude_ = sub_bucket_count_magnitude_ - 1;
+        sub_bucket_count_ = 1LL << sub_bucket_count_magnitude_;
+        sub_bucket_half_count_ = sub_bucket_count_ / 2;
+        sub_bucket_mask_ = sub_bucket_count_ - 1;
+
+        int bucket_count = 1;
+        int64_t smallest_untrackable = sub_bucket_count_;
+        while (smallest_untrackable <= highest) {
+            smallest_untrackable <<= 1;
+            bucket_count++;
+        }
+        highest_ = highest;
+        counts_.assign((bucket_count + 1) * sub_bucket_half_count_, 0);
+        total_ = 0;
+        min_ = INT64_MAX;
+        max_ = 0;
+    }
+
+    void Record(int64_t value, int64_t count = 1) {
+        if (value < 0) {
+            value = 0;
+        }
+        if (value > highest_) {
+            value = highest_;
+        }
+        counts_[CountsIndex(value)] += count;
+        total_ += count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void Merge(const HdrHistogram &other) {
+        for (size_t i = 0; i < counts_.size() && i < other.counts_.size(); i++) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    // percentile取值[0, 100]，返回该分位所在子桶的最大等价值
+    int64_t ValueAtPercentile(double percentile) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        int64_t target = (int64_t)(percentile / 100.0 * total_ + 0.5);
+        if (target < 1) {
+            target = 1;
+        }
+        int64_t acc = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            acc += counts_[i];
+            if (acc >= target) {
+                return std::min(HighestEquivalentValue(ValueFromIndex(i)), max_);
+            }
+        }
+        return max_;
+    }
+
+    double Mean() const {
+        if (total_ == 0) {
+            return 0;
+        }
+        double sum = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            if (counts_[i] > 0) {
+                sum += (double)counts_[i] * MedianEquivalentValue(ValueFromIndex(i));
+            }
+        }
+        return sum / total_;
+    }
+
+    int64_t TotalCount() const {
+        return total_;
+    }
+
+    int64_t Min() const {
+        return total_ == 0 ? 0 : min_;
+    }
+
+    int64_t Max() const {
+        return max_;
+    }
+
+private:
+    int BucketIndex(int64_t value) const {
+        int pow2ceiling = 64 - __builtin_clzll((uint64_t)(value | sub_bucket_mask_));
+        return pow2ceiling - (sub_bucket_half_count_magnitude_ + 1);
+    }
+
+    size_t CountsIndex(int64_t value) const {
+        int bucket_index = BucketIndex(value);
+        int64_t sub_bucket_index = value >> bucket_index;
+        int64_t bucket_base_index = (int64_t)(bucket_index + 1) << sub_bucket_half_count_magnitude_;
+        return bucket_base_index + sub_bucket_index - sub_bucket_half_count_;
+    }
+
+    int64_t ValueFromIndex(size_t index) const {
+        int bucket_index = (int)(index >> sub_bucket_half_count_magnitude_) - 1;
+        int64_t sub_bucket_index = (index & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+        if (bucket_index < 0) {
+            sub_bucket_index -= sub_bucket_half_count_;
+            bucket_index = 0;
+        }
+        return sub_bucket_index << bucket_index;
+    }
+
+    int64_t SizeOfEquivalentRange(int64_t value) const {
+        int bucket_index = BucketIndex(value);
+        int64_t sub_bucket_index = value >> bucket_index;
+        int adjusted = sub_bucket_index >= sub_bucket_count_ ? bucket_index + 1 : bucket_index;
+        return 1LL << adjusted;
+    }
+
+    int64_t HighestEquivalentValue(int64_t value) const {
+        return value + SizeOfEquivalentRange(value) - 1;
+    }
+
+    int64_t MedianEquivalentValue(int64_t value) const {
+        return value + SizeOfEquivalentRange(value) / 2;
+    }
+
+    int sub_bucket_count_magnitude_;
+
+    int sub_bucket_half_count_magnitude_;
+
+    int64_t sub_bucket_count_;
+
+    int64_t sub_bucket_half_count_;
+
+    int64_t sub_bucket_mask_;
+
+    int64_t highest_;
+
+    std::vector<int64_t> counts_;
+
+    int64_t total_;
+
+    int64_t min_;
+
+    int64_t max_;
+};
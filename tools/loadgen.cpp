@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "xfiber.h"
+#include "xsocket.h"
+#include "resp.h"
+#include "buffered_reader.h"
+#include "hdr_histogram.h"
+
+// 基于xfiber的压测工具，每个连接一个协程
+// 闭环模式：每个连接发出pipeline个请求，收齐响应后再发下一批
+// 开环模式(-R)：按固定速率发送，延迟从计划发送时间开始计算，修正coordinated omission
+
+struct Options {
+    Options() {
+        host_ = "127.0.0.1";
+        port_ = 7000;
+        conns_ = 100;
+        threads_ = 1;
+        duration_s_ = 10;
+        pipeline_ = 1;
+        rate_ = 0;
+        resp_ = true;
+        request_ = "PING";
+        spectrum_ = false;
+        spin_ = false;
+        timeout_ms_ = 5000;
+    }
+
+    std::string host_;
+    uint16_t port_;
+    int conns_;
+    int threads_;
+    int duration_s_;
+    int pipeline_;
+    // 所有连接的总发送速率（请求/秒），0表示闭环
+    double rate_;
+    bool resp_;
+    std::string request_;
+    bool spectrum_;
+    // 开环模式下用Yield自旋等待发送时间，精确到微秒但每个线程占满一个核
+    bool spin_;
+    int timeout_ms_;
+};
+
+struct Stats {
+    Stats() : requests_(0), responses_(0), errors_(0), bytes_out_(0), bytes_in_(0) {}
+
+    void Merge(const Stats &other) {
+        latency_us_.Merge(other.latency_us_);
+        requests_ += other.requests_;
+        responses_ += other.responses_;
+        errors_ += other.errors_;
+        bytes_out_ += other.bytes_out_;
+        bytes_in_ += other.bytes_in_;
+    }
+
+    HdrHistogram latency_us_;
+    int64_t requests_;
+    int64_t responses_;
+    int64_t errors_;
+    int64_t bytes_out_;
+    int64_t bytes_in_;
+};
+
+// 一个连接在开环模式下读写两个协程共享的状态
+struct ConnState {
+    ConnState() : writer_done_(false), broken_(false), writer_waiting_(nullptr), reader_waiting_(nullptr) {}
+
+    // 已发送未响应请求的计划发送时间
+    std::deque<int64_t> inflight_;
+    bool writer_done_;
+    bool broken_;
+    Fiber *writer_waiting_;
+    Fiber *reader_waiting_;
+};
+
+static int64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static std::string Unescape(const std::string &s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '\\' && i + 1 < s.size()) {
+            char c = s[++i];
+            out.push_back(c == 'r' ? '\r' : c == 'n' ? '\n' : c == 't' ? '\t' : c);
+        }
+        else {
+            out.push_back(s[i]);
+        }
+    }
+    return out;
+}
+
+// resp模式下把"SET k v"编码成multibulk，raw模式原样发送（支持\r\n转义）
+static std::string BuildRequest(const Options &opts) {
+    if (!opts.resp_) {
+        return Unescape(opts.request_);
+    }
+    std::vector<std::string> args;
+    size_t pos = 0;
+    while (pos < opts.request_.size()) {
+        size_t end = opts.request_.find(' ', pos);
+        if (end == std::string::npos) {
+            end = opts.request_.size();
+        }
+        if (end > pos) {
+            args.push_back(opts.request_.substr(pos, end - pos));
+        }
+        pos = end + 1;
+    }
+    RespWriter writer;
+    writer.AppendArrayHeader(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+        writer.AppendBulkString(args[i].data(), args[i].size());
+    }
+    return writer.Buffer();
+}
+
+// 读一次并解析出所有完整响应，返回响应个数；resp模式按RESP值分帧，raw模式按行分帧
+static ssize_t ReadResponses(const Options &opts, const Connection &conn, ReadBuffer &buf,
+                             std::vector<RespNode> &nodes, Stats &stats) {
+    ssize_t n = buf.Fill(conn, opts.timeout_ms_);
+    if (n <= 0) {
+        return -1;
+    }
+    stats.bytes_in_ += n;
+
+    ssize_t count = 0;
+    while (buf.Size() > 0) {
+        size_t consumed = 0;
+        if (opts.resp_) {
+            nodes.clear();
+            RespStatus status = RespParser::Parse(buf.Data(), buf.Size(), nodes, &consumed);
+            if (status == RESP_INCOMPLETE) {
+                break;
+            }
+            if (status == RESP_PROTOCOL_ERROR) {
+                return -1;
+            }
+            if (nodes[0].type_ == RESP_ERROR || nodes[0].type_ == RESP_BULK_ERROR) {
+                stats.errors_++;
+            }
+        }
+        else {
+            ssize_t crlf = util::FindCRLF(buf.Data(), buf.Size());
+            if (crlf < 0) {
+                break;
+            }
+            consumed = crlf + 2;
+        }
+        buf.Consume(consumed);
+        count++;
+    }
+    return count;
+}
+
+static void RunClosedLoop(const Options &opts, const Connection &conn, const std::string &batch, int64_t deadline, Stats &stats) {
+    ReadBuffer buf;
+    std::vector<RespNode> nodes;
+    while (NowNs() < deadline) {
+        int64_t send_at = NowNs();
+        if (conn.Write(batch.data(), batch.size(), opts.timeout_ms_) <= 0) {
+            stats.errors_++;
+            return;
+        }
+        stats.requests_ += opts.pipeline_;
+        stats.bytes_out_ += batch.size();
+
+        int remain = opts.pipeline_;
+        while (remain > 0) {
+            ssize_t n = ReadResponses(opts, conn, buf, nodes, stats);
+            if (n < 0) {
+                stats.errors_++;
+                return;
+            }
+            int64_t latency_us = (NowNs() - send_at) / 1000;
+            stats.latency_us_.Record(latency_us, n);
+            stats.responses_ += n;
+            remain -= n;
+        }
+    }
+}
+
+static void Park(Fiber *&slot) {
+    XFiber *xfiber = XFiber::xfiber();
+    slot = xfiber->CurrFiber();
+    xfiber->SwitchToSched();
+}
+
+static void Unpark(Fiber *&slot) {
+    if (slot != nullptr) {
+        Fiber *fiber = slot;
+        slot = nullptr;
+        XFiber::xfiber()->WakeupFiber(fiber);
+    }
+}
+
+static void RunOpenLoop(const Options &opts, const Connection &conn, const std::string &req, int64_t start,
+                        int64_t deadline, int64_t interval_ns, Stats &stats) {
+    XFiber *xfiber = XFiber::xfiber();
+    ConnState state;
+
+    // 写协程：按计划时间发送，落后时把所有到期请求合并成一次写
+    xfiber->CreateFiber([&opts, &conn, &req, &state, &stats, start, deadline, interval_ns, xfiber] {
+        std::string batch;
+        int64_t next = start;
+        while (next < deadline && !state.broken_) {
+            int64_t now = NowNs();
+            if (now < next) {
+                if (opts.spin_) {
+                    xfiber->Yield();
+                }
+                else {
+                    // 向上取整到毫秒睡眠，醒来时落后的请求在下面合并成一次写，
+                    // 不会让就绪队列一直非空导致epoll_wait空转占满CPU
+                    xfiber->SleepMs((next - now + 999999) / 1000000);
+                }
+                continue;
+            }
+
+            batch.clear();
+            while (next <= now && next < deadline && (int)state.inflight_.size() < opts.pipeline_) {
+                state.inflight_.push_back(next);
+                batch.append(req);
+                next += interval_ns;
+            }
+            if (!batch.empty()) {
+                Unpark(state.reader_waiting_);
+                if (conn.Write(batch.data(), batch.size(), opts.timeout_ms_) <= 0) {
+                    stats.errors_++;
+                    state.broken_ = true;
+                    break;
+                }
+                stats.requests_ += batch.size() / req.size();
+                stats.bytes_out_ += batch.size();
+            }
+            if ((int)state.inflight_.size() >= opts.pipeline_) {
+                Park(state.writer_waiting_);
+            }
+        }
+        state.writer_done_ = true;
+        Unpark(state.reader_waiting_);
+    }, 128 * 1024, "loadgen-writer");
+
+    // 读协程就是当前协程
+    ReadBuffer buf;
+    std::vector<RespNode> nodes;
+    while (!state.writer_done_ || (!state.inflight_.empty() && !state.broken_)) {
+        if (state.inflight_.empty() || state.broken_) {
+            Park(state.reader_waiting_);
+            continue;
+        }
+        ssize_t n = ReadResponses(opts, conn, buf, nodes, stats);
+        if (n < 0 || (size_t)n > state.inflight_.size()) {
+            stats.errors_++;
+            state.broken_ = true;
+            Unpark(state.writer_waiting_);
+            continue;
+        }
+        int64_t now = NowNs();
+        for (ssize_t i = 0; i < n; i++) {
+            stats.latency_us_.Record((now - state.inflight_.front()) / 1000);
+            state.inflight_.pop_front();
+        }
+        stats.responses_ += n;
+        Unpark(state.writer_waiting_);
+    }
+}
+
+static void RunThread(const Options &opts, int thread_index, int conns, Stats &stats) {
+    XFiber *xfiber = XFiber::xfiber();
+    std::string req = BuildRequest(opts);
+    std::string batch;
+    for (int i = 0; i < opts.pipeline_; i++) {
+        batch.append(req);
+    }
+
+    int64_t start = NowNs();
+    int64_t deadline = start + (int64_t)opts.duration_s_ * 1000000000;
+    int64_t interval_ns = opts.rate_ > 0 ? (int64_t)(1e9 * opts.conns_ / opts.rate_) : 0;
+    int remain = conns;
+
+    for (int c = 0; c < conns; c++) {
+        // 各连接的发送时间错开，避免所有连接在同一时刻突发
+        int64_t conn_start = start + (interval_ns * (thread_index + c * opts.threads_)) / opts.conns_;
+        xfiber->CreateFiber([&, conn_start] {
+            std::shared_ptr<Connection> conn = Connection::ConnectTCP(opts.host_.c_str(), opts.port_);
+            if (!conn->Available()) {
+                stats.errors_++;
+            }
+            else if (interval_ns > 0) {
+                RunOpenLoop(opts, *conn, req, conn_start, deadline, interval_ns, stats);
+            }
+            else {
+                RunClosedLoop(opts, *conn, batch, deadline, stats);
+            }
+            conn.reset();
+            if (--remain == 0) {
+                xfiber->Stop();
+            }
+        }, 128 * 1024, "loadgen-conn");
+    }
+    xfiber->Dispatch();
+}
+
+static void PrintSpectrum(const HdrHistogram &hist) {
+    printf("\n  Detailed Percentile spectrum:\n");
+    printf("%12s %14s %10s %14s\n\n", "Value(us)", "Percentile", "TotalCount", "1/(1-Percentile)");
+    // 每个"半程"取5个点：0, 50, 75, 87.5 ...，和HdrHistogram的输出格式一致
+    double percentile = 0;
+    double step = 10.0;
+    while (true) {
+        int64_t value = hist.ValueAtPercentile(percentile);
+        int64_t count = (int64_t)(percentile / 100.0 * hist.TotalCount());
+        if (percentile < 100.0) {
+            printf("%12" PRId64 " %14.6f %10" PRId64 " %14.2f\n", value, percentile / 100.0, count, 1.0 / (1.0 - percentile / 100.0));
+        }
+        if (percentile >= 100.0 || count >= hist.TotalCount()) {
+            printf("%12" PRId64 " %14.6f %10" PRId64 "\n", hist.Max(), 1.0, hist.TotalCount());
+            break;
+        }
+        percentile += step;
+        if (100.0 - percentile <= step * 5 - 1e-9) {
+            step /= 2;
+        }
+        if (step < 1e-7) {
+            percentile = 100.0;
+        }
+    }
+}
+
+static void Usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -h <host>      server ipv4 address (default 127.0.0.1)\n"
+            "  -p <port>      server port (default 7000)\n"
+            "  -c <conns>     concurrent connections (default 100)\n"
+            "  -t <threads>   xfiber threads (default 1)\n"
+            "  -d <seconds>   test duration (default 10)\n"
+            "  -P <depth>     pipeline depth per connection (default 1)\n"
+            "  -R <rate>      total requests/sec, enables open-loop mode with\n"
+            "                 coordinated omission correction (default closed-loop)\n"
+            "  -S             open-loop: spin until each send time instead of sleeping;\n"
+            "                 without it the ms timer can add up to ~2ms to measured\n"
+            "                 latency, with it every thread burns a full core\n"
+            "  -m <mode>      resp | raw (default resp)\n"
+            "  -r <request>   resp: command like \"SET k v\"; raw: payload with \\r\\n escapes\n"
+            "                 raw responses are framed by \\r\\n (default \"PING\")\n"
+            "  -T <ms>        per read/write timeout (default 5000)\n"
+            "  -L             print detailed latency spectrum\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    signal(SIGPIPE, SIG_IGN);
+
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:t:d:P:R:m:r:T:LS")) != -1) {
+        switch (opt) {
+            case 'h': opts.host_ = optarg; break;
+            case 'p': opts.port_ = atoi(optarg); break;
+            case 'c': opts.conns_ = atoi(optarg); break;
+            case 't': opts.threads_ = atoi(optarg); break;
+            case 'd': opts.duration_s_ = atoi(optarg); break;
+            case 'P': opts.pipeline_ = atoi(optarg); break;
+            case 'R': opts.rate_ = atof(optarg); break;
+            case 'm': opts.resp_ = std::string(optarg) != "raw"; break;
+            case 'r': opts.request_ = optarg; break;
+            case 'T': opts.timeout_ms_ = atoi(optarg); break;
+            case 'L': opts.spectrum_ = true; break;
+            case 'S': opts.spin_ = true; break;
+            default: Usage(argv[0]); return 1;
+        }
+    }
+    if (opts.conns_ <= 0 || opts.threads_ <= 0 || opts.pipeline_ <= 0 || opts.duration_s_ <= 0 || opts.request_.empty()) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (opts.threads_ > opts.conns_) {
+        opts.threads_ = opts.conns_;
+    }
+
+    printf("Running %ds test @ %s:%d\n", opts.duration_s_, opts.host_.c_str(), opts.port_);
+    printf("  %d threads and %d connections, pipeline %d, %s\n", opts.threads_, opts.conns_, opts.pipeline_,
+           opts.rate_ > 0 ? "open-loop" : "closed-loop");
+
+    Stats total;
+    std::mutex mutex;
+    std::vector<std::thread> threads;
+    int64_t begin = NowNs();
+    for (int i = 0; i < opts.threads_; i++) {
+        int conns = opts.conns_ / opts.threads_ + (i < opts.conns_ % opts.threads_ ? 1 : 0);
+        threads.push_back(std::thread([&opts, &total, &mutex, i, conns] {
+            Stats stats;
+            RunThread(opts, i, conns, stats);
+            std::lock_guard<std::mutex> lock(mutex);
+            total.Merge(stats);
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    double elapsed_s = (NowNs() - begin) / 1e9;
+
+    const HdrHistogram &hist = total.latency_us_;
+    printf("\n  Latency (us)%s:\n", opts.rate_ > 0 ? ", measured from intended send time" : "");
+    printf("    mean %.1f  min %" PRId64 "  max %" PRId64 "\n", hist.Mean(), hist.Min(), hist.Max());
+    const double percentiles[] = {50, 75, 90, 99, 99.9, 99.99, 99.999, 100};
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        printf("    %8.3f%%  %" PRId64 "\n", percentiles[i], hist.ValueAtPercentile(percentiles[i]));
+    }
+    if (opts.spectrum_) {
+        PrintSpectrum(hist);
+    }
+
+    printf("\n  %" PRId64 " requests, %" PRId64 " responses in %.2fs, %.2fMB read, %.2fMB written\n",
+           total.requests_, total.responses_, elapsed_s, total.bytes_in_ / 1048576.0, total.bytes_out_ / 1048576.0);
+    printf("  Errors: %" PRId64 "\n", total.errors_);
+    printf("Requests/sec: %.2f\n", total.responses_ / elapsed_s);
+    return 0;
+}
@@ -1,5 +1,11 @@
+#include <time.h>
 #include "util.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTIL_X86_SIMD 1
+#endif
+
 namespace util {
 
 int64_t NowMs() {
@@ -8,4 +14,184 @@ int64_t NowMs() {
     return int64_t(tv.tv_sec * 1000) + tv.tv_usec / 1000;
 }
 
-}
\ No newline at end of file
+int64_t NowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static ssize_t FindCRLFScalar(const char *buf, size_t len, size_t from) {
+    while (from < len) {
+        const char *p = (const char *)memchr(buf + from, '\r', len - from);
+        if (p == nullptr) {
+            return -1;
+        }
+        size_t pos = p - buf;
+        if (pos + 1 >= len) {
+            return -1;
+        }
+        if (buf[pos + 1] == '\n') {
+            return pos;
+        }
+        from = pos + 1;
+    }
+    return -1;
+}
+
+static inline bool IsCtl(unsigned char c) {
+    return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+static ssize_t FindCtlScalar(const char *buf, size_t len, size_t from) {
+    for (size_t i = from; i < len; i++) {
+        if (IsCtl(buf[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#ifdef UTIL_X86_SIMD
+
+// 匹配到'\r'后再检查下一个字节，块尾的'\r'交给下一轮/标量处理
+static inline ssize_t CheckMask(const char *buf, size_t len, size_t base, uint32_t mask) {
+    while (mask != 0) {
+        size_t pos = base + __builtin_ctz(mask);
+        if (pos + 1 < len && buf[pos + 1] == '\n') {
+            return pos;
+        }
+        mask &= mask - 1;
+    }
+    return -1;
+}
+
+static ssize_t FindCRLFSSE2(const char *buf, size_t len) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, cr));
+        ssize_t pos = CheckMask(buf, len, i, mask);
+        if (pos >= 0) {
+            return pos;
+        }
+    }
+    return FindCRLFScalar(buf, len, i);
+}
+
+__attribute__((target("avx2")))
+static ssize_t FindCRLFAVX2(const char *buf, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(buf + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, cr));
+        ssize_t pos = CheckMask(buf, len, i, mask);
+        if (pos >= 0) {
+            return pos;
+        }
+    }
+    return FindCRLFScalar(buf, len, i);
+}
+
+static ssize_t FindCtlSSE2(const char *buf, size_t len) {
+    const __m128i max_ctl = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i tab = _mm_set1_epi8('\t');
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+        // 无符号比较 c <= 0x1f 等价于 min(c, 0x1f) == c
+        __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(chunk, max_ctl), chunk);
+        ctl = _mm_or_si128(ctl, _mm_cmpeq_epi8(chunk, del));
+        ctl = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, tab), ctl);
+        uint32_t mask = _mm_movemask_epi8(ctl);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return FindCtlScalar(buf, len, i);
+}
+
+__attribute__((target("avx2")))
+static ssize_t FindCtlAVX2(const char *buf, size_t len) {
+    const __m256i max_ctl = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, max_ctl), chunk);
+        ctl = _mm256_or_si256(ctl, _mm256_cmpeq_epi8(chunk, del));
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, tab), ctl);
+        uint32_t mask = _mm256_movemask_epi8(ctl);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return FindCtlScalar(buf, len, i);
+}
+
+static bool HasAVX2() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+#endif
+
+ssize_t FindCRLF(const char *buf, size_t len) {
+#ifdef UTIL_X86_SIMD
+    // 短行（RESP的类型头、长度）直接走标量，避免SIMD启动开销
+    if (len < 16) {
+        return FindCRLFScalar(buf, len, 0);
+    }
+    if (HasAVX2()) {
+        return FindCRLFAVX2(buf, len);
+    }
+    return FindCRLFSSE2(buf, len);
+#else
+    return FindCRLFScalar(buf, len, 0);
+#endif
+}
+
+ssize_t FindCtl(const char *buf, size_t len) {
+#ifdef UTIL_X86_SIMD
+    if (len < 16) {
+        return FindCtlScalar(buf, len, 0);
+    }
+    if (HasAVX2()) {
+        return FindCtlAVX2(buf, len);
+    }
+    return FindCtlSSE2(buf, len);
+#else
+    return FindCtlScalar(buf, len, 0);
+#endif
+}
+
+bool ParseInt64(const char *buf, size_t len, int64_t *value) {
+    size_t i = 0;
+    bool negative = false;
+    if (len > 0 && buf[0] == '-') {
+        negative = true;
+        i = 1;
+    }
+    // 最多19位十进制，保证uint64_t累加不溢出
+    if (len == i || len - i > 19) {
+        return false;
+    }
+    uint64_t v = 0;
+    for (; i < len; i++) {
+        unsigned d = (unsigned char)buf[i] - '0';
+        if (d > 9) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    if (v > (uint64_t)INT64_MAX + (negative ? 1 : 0)) {
+        return false;
+    }
+    *value = negative ? (int64_t)(0 - v) : (int64_t)v;
+    return true;
+}
+
+}
@@ -1,6 +1,8 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <string>
+#include <cstring>
 #include <unistd.h>
 #include <inttypes.h>
 #include <sys/time.h>
@@ -9,6 +11,52 @@ namespace util {
 
 int64_t NowMs();
 
+// 单调时钟，用于测量微秒级的间隔
+int64_t NowUs();
+
+// 指向外部缓冲区的只读视图，不拥有内存，底层缓冲区变化后失效
+class Slice {
+public:
+    Slice() : data_(nullptr), size_(0) {}
+
+    Slice(const char *data, size_t size) : data_(data), size_(size) {}
+
+    const char *Data() const { return data_; }
+
+    size_t Size() const { return size_; }
+
+    bool Empty() const { return size_ == 0; }
+
+    char operator[](size_t i) const { return data_[i]; }
+
+    std::string ToString() const { return std::string(data_, size_); }
+
+    bool Equals(const char *s) const {
+        size_t n = strlen(s);
+        return n == size_ && memcmp(data_, s, n) == 0;
+    }
+
+    bool EqualsIgnoreCase(const char *s) const {
+        size_t n = strlen(s);
+        return n == size_ && strncasecmp(data_, s, n) == 0;
+    }
+
+private:
+    const char *data_;
+    size_t size_;
+};
+
+// 在[buf, buf+len)中查找第一个"\r\n"，返回'\r'的偏移，找不到返回-1
+// x86上按CPU能力使用AVX2/SSE2，每次比较32/16字节
+ssize_t FindCRLF(const char *buf, size_t len);
+
+// 查找第一个控制字符(<0x20或0x7f，'\t'除外)，返回偏移，找不到返回-1
+// 用于HTTP头部：行尾的'\r'本身就是控制字符，一次扫描同时完成定界和合法性校验
+ssize_t FindCtl(const char *buf, size_t len);
+
+// 解析十进制整数（可带'-'），成功返回true
+bool ParseInt64(const char *buf, size_t len, int64_t *value);
+
 }
 
-#endif
\ No newline at end of file
+#endif
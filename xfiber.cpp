@@ -3,24 +3,69 @@
 #include <error.h>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <unistd.h>
 #include <assert.h>
 #include "xfiber.h"
 
+// 6.9以上内核才有epoll忙轮询参数，旧头文件里没有定义时按内核ABI自行声明
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
 
-XFiber::XFiber() {
+
+XFiber::XFiber() : notified_(false) {
     curr_fiber_ = nullptr;
+    stopped_ = false;
+    busy_poll_ = false;
+    spin_budget_us_ = 0;
+    idle_gap_x8_ = -1;
+    live_fibers_ = 0;
+    ready_count_ = 0;
+    live_connections_ = 0;
+    min_delay_us_ = INT64_MAX;
+    last_min_delay_us_ = 0;
+    interval_end_us_ = 0;
+    overloaded_ = false;
+    last_poll_us_ = 0;
+    io_ready_at_us_ = 0;
+    tracer_ = Tracer::tracer();
     efd_ = epoll_create1(0);
     if (efd_ < 0) {
         LOG_ERROR("epoll_create failed, msg=%s", strerror(errno));
         exit(-1);
     }
+
+    notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify_fd_ < 0) {
+        LOG_ERROR("eventfd failed, msg=%s", strerror(errno));
+        exit(-1);
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = notify_fd_;
+    if (epoll_ctl(efd_, EPOLL_CTL_ADD, notify_fd_, &ev) < 0) {
+        LOG_ERROR("add notify fd [%d] into epoll failed, msg=%s", notify_fd_, strerror(errno));
+        exit(-1);
+    }
 }
 
 XFiber::~XFiber() {
+    close(notify_fd_);
     close(efd_);
 }
 
@@ -28,25 +73,90 @@ XFiberCtx *XFiber::SchedCtx() {
     return &sched_ctx_;
 }
 
+Fiber *XFiber::CurrFiber() {
+    return curr_fiber_;
+}
+
+void XFiber::Post(std::function<void()> task) {
+    RemoteTask remote_task;
+    remote_task.task_ = std::move(task);
+    PushRemote(std::move(remote_task));
+}
+
+void XFiber::RemoteWakeup(Fiber *fiber) {
+    RemoteTask remote_task;
+    remote_task.fiber_ = fiber;
+    PushRemote(std::move(remote_task));
+}
+
+void XFiber::PushRemote(RemoteTask task) {
+    remote_tasks_.Push(std::move(task));
+    // 调度线程消费前只需要一次eventfd写入，后续投递直接合并
+    if (!notified_.exchange(true, std::memory_order_acq_rel)) {
+        uint64_t one = 1;
+        if (write(notify_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_ERROR("write notify fd[%d] failed, msg=%s", notify_fd_, strerror(errno));
+        }
+    }
+}
+
+void XFiber::DrainRemote() {
+    // 先清标志再消费，消费期间的新投递会重新写eventfd，不会丢通知
+    notified_.store(false, std::memory_order_seq_cst);
+
+    // 每轮最多处理一批，避免远端投递过快饿死本线程的协程和IO
+    #define MAX_REMOTE_BATCH 1024
+    RemoteTask remote_task;
+    for (int i = 0; i < MAX_REMOTE_BATCH && remote_tasks_.Pop(remote_task); i++) {
+        if (remote_task.fiber_ != nullptr) {
+            WakeupFiber(remote_task.fiber_);
+        }
+        else if (remote_task.task_) {
+            remote_task.task_();
+        }
+        remote_task = RemoteTask();
+    }
+}
+
 void XFiber::WakeupFiber(Fiber *fiber) {
     LOG_DEBUG("try wakeup fiber[%lu] %p", fiber->Seq(), fiber);
     // 1. 加入就绪队列
-    ready_fibers_.push_back(fiber);
+    // 同一轮里可能被超时和IO/Future先后唤醒，已经在就绪队列中的不能重复入队；
+    // 但仍要清理下面的等待登记（比如登记了超时后又Yield的协程），否则超时队列无法前进
+    if (fiber->Status() == FiberStatus::READYING) {
+        LOG_DEBUG("fiber[%lu] is already in ready list, only clear its waiting events", fiber->Seq());
+    }
+    else {
+        if (tracer_->SampleFiber(fiber->Seq())) {
+            tracer_->Record(TRACE_FIBER_WAKE, fiber->Seq());
+        }
+        PushReady(fiber);
+    }
 
-    // 2. 从等待队列中删除
+    // 2. 从等待队列中删除，只清理本协程占用的读/写槽位，不影响同一fd上另一方向的等待者
     WaitingEvents &waiting_events = fiber->GetWaitingEvents();
     for (size_t i = 0; i < waiting_events.waiting_fds_r_.size(); i++) {
         int fd = waiting_events.waiting_fds_r_[i];
         auto iter = io_waiting_fibers_.find(fd);
         if (iter != io_waiting_fibers_.end()) {
-            io_waiting_fibers_.erase(iter);
+            if (iter->second.r_ == fiber) {
+                iter->second.r_ = nullptr;
+            }
+            if (iter->second.r_ == nullptr && iter->second.w_ == nullptr) {
+                io_waiting_fibers_.erase(iter);
+            }
         }
     }
     for (size_t i = 0; i < waiting_events.waiting_fds_w_.size(); i++) {
         int fd = waiting_events.waiting_fds_w_[i];
         auto iter = io_waiting_fibers_.find(fd);
         if (iter != io_waiting_fibers_.end()) {
-            io_waiting_fibers_.erase(iter);
+            if (iter->second.w_ == fiber) {
+                iter->second.w_ = nullptr;
+            }
+            if (iter->second.r_ == nullptr && iter->second.w_ == nullptr) {
+                io_waiting_fibers_.erase(iter);
+            }
         }
     }
 
@@ -54,7 +164,7 @@ void XFiber::WakeupFiber(Fiber *fiber) {
     int64_t expire_at = waiting_events.expire_at_;
     if (expire_at > 0) {
         auto expired_iter = expire_events_.find(expire_at);
-        if (expired_iter->second.find(fiber) == expired_iter->second.end()) {
+        if (expired_iter == expire_events_.end() || expired_iter->second.find(fiber) == expired_iter->second.end()) {
             LOG_WARNING("not fiber [%lu] in expired events", fiber->Seq());
         }
         else {
@@ -62,6 +172,9 @@ void XFiber::WakeupFiber(Fiber *fiber) {
             expired_iter->second.erase(fiber);
         }
     }
+
+    // 4. 清空等待事件，下次挂起时重新登记
+    waiting_events.Reset();
     LOG_DEBUG("fiber [%lu] %p has wakeup success, ready to run!", fiber->Seq(), fiber);
 }
 
@@ -70,12 +183,44 @@ void XFiber::CreateFiber(std::function<void ()> run, size_t stack_size, std::str
         stack_size = 1024 * 1024;
     }
     Fiber *fiber = new Fiber(run, this, stack_size, fiber_name);
-    ready_fibers_.push_back(fiber);
+    if (tracer_->SampleFiber(fiber->Seq())) {
+        tracer_->Record(TRACE_FIBER_CREATE, fiber->Seq());
+    }
+    live_fibers_++;
+    PushReady(fiber);
     LOG_DEBUG("create a new fiber with id[%lu]", fiber->Seq());
 }
 
+bool XFiber::TryCreateFiber(std::function<void ()> run, size_t stack_size, std::string fiber_name) {
+    if (overload_config_.max_fibers_ > 0 && live_fibers_ >= overload_config_.max_fibers_) {
+        LOG_WARNING("live fibers reach limit %lu, reject fiber[%s]", overload_config_.max_fibers_, fiber_name.c_str());
+        return false;
+    }
+    CreateFiber(run, stack_size, fiber_name);
+    return true;
+}
+
+void XFiber::PushReady(Fiber *fiber) {
+    fiber->SetStatus(FiberStatus::READYING);
+    ready_count_++;
+    if (overload_config_.target_delay_us_ > 0) {
+        if (io_ready_at_us_ > 0) {
+            fiber->SetReadyAt(io_ready_at_us_, true);
+        }
+        else {
+            fiber->SetReadyAt(util::NowUs(), false);
+        }
+    }
+    ready_fibers_.push_back(fiber);
+}
+
+void XFiber::Stop() {
+    stopped_ = true;
+}
+
 void XFiber::Dispatch() {
-    while (true) {
+    stopped_ = false;
+    while (!stopped_) {
         if (ready_fibers_.size() > 0) {
             running_fibers_ = std::move(ready_fibers_);
             ready_fibers_.clear();
@@ -84,12 +229,33 @@ void XFiber::Dispatch() {
             for (auto iter = running_fibers_.begin(); iter != running_fibers_.end(); iter++) {
                 Fiber *fiber = *iter;
                 curr_fiber_ = fiber;
+                // 离开就绪队列，切回调度器后如果没有再次入队就处于等待状态
+                fiber->SetStatus(FiberStatus::WAITING);
+                ready_count_--;
+                if (overload_config_.target_delay_us_ > 0 && fiber->ReadyAt() > 0) {
+                    int64_t now_us = util::NowUs();
+                    fiber->SetQueueDelay(now_us - fiber->ReadyAt());
+                    // 只有IO唤醒的协程代表请求的排队时间，定时器、Yield等唤醒的协程
+                    // （比如暂停accept时轮询的协程）不计入，否则会把最小值拉低
+                    if (fiber->ReadyByIo()) {
+                        UpdateQueueDelay(fiber->QueueDelayUs(), now_us);
+                    }
+                    fiber->SetReadyAt(0, false);
+                }
+                bool traced = tracer_->SampleFiber(fiber->Seq());
+                if (traced) {
+                    tracer_->Record(TRACE_FIBER_RUN, fiber->Seq());
+                }
                 LOG_DEBUG("switch from sched to fiber[%lu]", fiber->Seq());
                 assert(SwitchCtx(SchedCtx(), fiber->Ctx()) == 0);
                 curr_fiber_ = nullptr;
+                if (traced) {
+                    tracer_->Record(fiber->IsFinished() ? TRACE_FIBER_FINISH : TRACE_FIBER_PARK, fiber->Seq());
+                }
 
                 if (fiber->IsFinished()) {
                     LOG_INFO("fiber[%lu] finished, free it!", fiber->Seq());
+                    live_fibers_--;
                     delete fiber;
                 }
             }
@@ -101,16 +267,45 @@ void XFiber::Dispatch() {
             std::set<Fiber *> &expired_fibers = expire_events_.begin()->second;
             while (!expired_fibers.empty()) {
                 std::set<Fiber *>::iterator expired_fiber = expired_fibers.begin();
-                WakeupFiber(*expired_fiber);
+                if (tracer_->SampleFiber((*expired_fiber)->Seq())) {
+                    tracer_->Record(TRACE_TIMER_EXPIRE, (*expired_fiber)->Seq());
+                }
+                Fiber *fiber = *expired_fiber;
+                WakeupFiber(fiber);
+                // WakeupFiber正常会把它从这里删除，再删一次保证循环一定能前进
+                expired_fibers.erase(fiber);
             }
             expire_events_.erase(expire_events_.begin());
         }
 
+        DrainRemote();
+
         #define MAX_EVENT_COUNT 512
         struct epoll_event evs[MAX_EVENT_COUNT];
-        int n = epoll_wait(efd_, evs, MAX_EVENT_COUNT, 2);
+        // 已经有就绪协程或者未处理完的远端任务时不阻塞
+        int timeout_ms = (ready_fibers_.empty() && remote_tasks_.Empty()) ? 2 : 0;
+        bool traced = tracer_->SampleEpoll();
+        uint64_t wait_begin = traced ? Tracer::Now() : 0;
+        bool measure_delay = overload_config_.target_delay_us_ > 0;
+        int64_t poll_begin_us = measure_delay ? util::NowUs() : 0;
+        int n = PollEvents(evs, MAX_EVENT_COUNT, timeout_ms);
+        if (traced) {
+            tracer_->Record(TRACE_EPOLL_WAIT, n > 0 ? n : 0, Tracer::Now() - wait_begin);
+        }
+        if (measure_delay) {
+            int64_t poll_end_us = util::NowUs();
+            // 没有阻塞就返回的事件是在上一轮运行协程期间到达的，按该区间的中点估算到达时间，
+            // 否则一整轮的执行时间都不会计入排队延迟；阻塞后才到达的事件按返回时间算
+            if (n > 0) {
+                bool blocked = poll_end_us - poll_begin_us >= 20 || last_poll_us_ == 0;
+                io_ready_at_us_ = blocked ? poll_end_us : (last_poll_us_ + poll_begin_us) / 2;
+            }
+            last_poll_us_ = poll_end_us;
+        }
         if (n < 0) {
-            LOG_ERROR("epoll_wait error, msg=%s", strerror(errno));
+            if (errno != EINTR) {
+                LOG_ERROR("epoll_wait error, msg=%s", strerror(errno));
+            }
             continue;
         }
 
@@ -118,31 +313,234 @@ void XFiber::Dispatch() {
             struct epoll_event &ev = evs[i];
             int fd = ev.data.fd;
 
+            if (fd == notify_fd_) {
+                uint64_t count;
+                while (read(notify_fd_, &count, sizeof(count)) > 0) {
+                }
+                continue;
+            }
+
             auto fiber_iter = io_waiting_fibers_.find(fd);
-            if (fiber_iter != io_waiting_fibers_.end()) {
-                WaitingFibers &waiting_fiber = fiber_iter->second;
-                if (ev.events & EPOLLIN) {
-                    LOG_DEBUG("waiting fd[%d] has fired IN event, wake up pending fiber[%lu]", fd, waiting_fiber.r_->Seq());
-                    WakeupFiber(waiting_fiber.r_);
+            if (fiber_iter == io_waiting_fibers_.end()) {
+                continue;
+            }
+
+            // 先取出两个槽位，唤醒读协程时可能会删除该fd的等待项
+            Fiber *r_fiber = fiber_iter->second.r_;
+            Fiber *w_fiber = fiber_iter->second.w_;
+
+            // 出错或对端关闭时读写双方都需要唤醒，由read/write返回具体错误
+            bool broken = (ev.events & (EPOLLERR | EPOLLHUP)) != 0;
+            if ((ev.events & (EPOLLIN | EPOLLRDHUP)) || broken) {
+                if (r_fiber != nullptr) {
+                    LOG_DEBUG("waiting fd[%d] has fired IN event 0x%x, wake up pending fiber[%lu]", fd, ev.events, r_fiber->Seq());
+                    WakeupFiber(r_fiber);
                 }
-                else if (ev.events & EPOLLOUT) {
-                    if (waiting_fiber.w_ == nullptr) {
-                        LOG_WARNING("fd[%d] has been fired OUT event, but not found any fiber to handle!", fd);
-                    }
-                    else {
-                        LOG_DEBUG("waiting fd[%d] has fired OUT event, wake up pending fiber[%lu]", fd, waiting_fiber.w_->Seq());
-                        WakeupFiber(waiting_fiber.w_);
-                    }
+            }
+            if ((ev.events & EPOLLOUT) || broken) {
+                // 同一个协程可能同时等待读写，只有IN事件已经唤醒过它时才会重复，WakeupFiber会忽略已就绪的协程
+                if (w_fiber != nullptr) {
+                    LOG_DEBUG("waiting fd[%d] has fired OUT event 0x%x, wake up pending fiber[%lu]", fd, ev.events, w_fiber->Seq());
+                    WakeupFiber(w_fiber);
                 }
             }
         }
+        io_ready_at_us_ = 0;
+
+        // 每轮都检查窗口是否结束，空闲时也能按时退出过载状态
+        if (measure_delay) {
+            CheckOverload(last_poll_us_);
+        }
     }
 }
 
+int XFiber::PollEvents(struct epoll_event *evs, int max_events, int timeout_ms) {
+    if (!busy_poll_ || timeout_ms == 0) {
+        return epoll_wait(efd_, evs, max_events, timeout_ms);
+    }
+
+    // 自旋期间远端投递会写eventfd，同样能被零超时的epoll_wait及时发现
+    int64_t idle_begin = util::NowUs();
+    int64_t now = idle_begin;
+    int n = 0;
+    while (now - idle_begin < spin_budget_us_) {
+        n = epoll_wait(efd_, evs, max_events, 0);
+        now = util::NowUs();
+        if (n != 0) {
+            if (n > 0) {
+                AdaptSpinBudget(now - idle_begin);
+            }
+            return n;
+        }
+    }
+
+    n = epoll_wait(efd_, evs, max_events, timeout_ms);
+    if (n >= 0) {
+        // 阻塞等待超时也说明这段时间没有事件，按间隔计入
+        AdaptSpinBudget(util::NowUs() - idle_begin);
+    }
+    return n;
+}
+
+void XFiber::AdaptSpinBudget(int64_t gap_us) {
+    if (!busy_poll_config_.adaptive_) {
+        return;
+    }
+    // 1/8权重的指数滑动平均，和TCP的srtt一样存放8倍的值，避免整数除法把小于8us的变化截掉
+    if (idle_gap_x8_ < 0) {
+        idle_gap_x8_ = gap_us * 8;
+    }
+    else {
+        idle_gap_x8_ += gap_us - idle_gap_x8_ / 8;
+    }
+    int max_spin_us = busy_poll_config_.max_spin_us_;
+    int min_spin_us = busy_poll_config_.min_spin_us_;
+    if (idle_gap_x8_ > (int64_t)max_spin_us * 8) {
+        // 事件间隔超过自旋上限，大部分自旋都会落空，只保留最小探测
+        spin_budget_us_ = min_spin_us;
+    }
+    else {
+        // 留一倍余量覆盖抖动，事件通常能在自旋期间到达；向上取整，保证不小于平均间隔的两倍
+        int budget_us = (int)((idle_gap_x8_ + 3) / 4);
+        spin_budget_us_ = std::max(min_spin_us, std::min(max_spin_us, budget_us));
+    }
+}
+
+bool XFiber::EnableBusyPoll(const BusyPollConfig &config) {
+    busy_poll_config_ = config;
+    busy_poll_ = true;
+    spin_budget_us_ = config.max_spin_us_;
+    idle_gap_x8_ = -1;
+
+    if (config.socket_busy_poll_us_ > 0) {
+        struct epoll_params params;
+        memset(&params, 0, sizeof(params));
+        params.busy_poll_usecs = config.socket_busy_poll_us_;
+        params.busy_poll_budget = 8;
+        params.prefer_busy_poll = 1;
+        if (ioctl(efd_, EPIOCSPARAMS, &params) < 0) {
+            // 旧内核不支持时只依赖socket上的SO_BUSY_POLL
+            LOG_WARNING("set epoll busy poll params failed, msg=%s", strerror(errno));
+        }
+    }
+
+    if (config.cpu_ >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config.cpu_, &cpus);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (ret != 0) {
+            LOG_ERROR("pin sched thread to cpu[%d] failed, msg=%s", config.cpu_, strerror(ret));
+            return false;
+        }
+        LOG_INFO("pin sched thread to cpu[%d] success", config.cpu_);
+    }
+    return true;
+}
+
+void XFiber::DisableBusyPoll() {
+    busy_poll_ = false;
+    spin_budget_us_ = 0;
+}
+
+int XFiber::SpinBudgetUs() const {
+    return busy_poll_ ? spin_budget_us_ : 0;
+}
+
+void XFiber::SetOverloadConfig(const OverloadConfig &config) {
+    overload_config_ = config;
+    min_delay_us_ = INT64_MAX;
+    last_min_delay_us_ = 0;
+    interval_end_us_ = 0;
+    overloaded_ = false;
+}
+
+void XFiber::UpdateQueueDelay(int64_t delay_us, int64_t now_us) {
+    if (delay_us < min_delay_us_) {
+        min_delay_us_ = delay_us;
+    }
+    CheckOverload(now_us);
+}
+
+void XFiber::CheckOverload(int64_t now_us) {
+    if (interval_end_us_ == 0) {
+        interval_end_us_ = now_us + overload_config_.interval_ms_ * 1000;
+        return;
+    }
+    if (now_us < interval_end_us_) {
+        return;
+    }
+
+    // 用窗口内的最小值判断：突发流量造成的短暂排队会在窗口内消化掉，不会被误判为过载，
+    // 只有持续排队（最快被调度的协程都超过目标）才进入过载状态
+    // 窗口内没有样本（负载已经停止）或者就绪队列已经排空时没有积压，和CoDel在队列排空时
+    // 退出丢包状态一样直接退出，否则暂停accept后不会再有新样本，过载状态永远无法解除
+    bool has_sample = min_delay_us_ != INT64_MAX;
+    bool overloaded = has_sample && ready_count_ > 0 && min_delay_us_ > overload_config_.target_delay_us_;
+    int64_t min_delay_us = has_sample ? min_delay_us_ : 0;
+    if (overloaded != overloaded_) {
+        LOG_WARNING("sched %s overload, min queue delay %ldus, target %ldus, ready fibers %lu",
+                    overloaded ? "enter" : "leave", min_delay_us, overload_config_.target_delay_us_, ready_count_);
+    }
+    overloaded_ = overloaded;
+    last_min_delay_us_ = min_delay_us;
+    min_delay_us_ = INT64_MAX;
+    interval_end_us_ = now_us + overload_config_.interval_ms_ * 1000;
+}
+
+bool XFiber::AcceptPaused() const {
+    const OverloadConfig &config = overload_config_;
+    if (config.max_fibers_ > 0 && live_fibers_ >= config.max_fibers_) {
+        return true;
+    }
+    if (config.max_connections_ > 0 && live_connections_ >= config.max_connections_) {
+        return true;
+    }
+    if (config.max_ready_fibers_ > 0 && ready_count_ > config.max_ready_fibers_) {
+        return true;
+    }
+    return overloaded_;
+}
+
+bool XFiber::Overloaded() const {
+    return overloaded_;
+}
+
+bool XFiber::ShouldShed() {
+    if (curr_fiber_ == nullptr) {
+        return false;
+    }
+    // 排队延迟只对应最近一次唤醒，用过就清零：之后没有挂起就直接读到的数据并没有在就绪队列里等过，
+    // 否则一个一直有数据、从不挂起的流水线连接会在过载期间持续被拒绝
+    int64_t delay_us = curr_fiber_->QueueDelayUs();
+    curr_fiber_->SetQueueDelay(0);
+    return overloaded_ && delay_us > overload_config_.target_delay_us_ * 2;
+}
+
+int64_t XFiber::QueueDelayUs() const {
+    return last_min_delay_us_;
+}
+
+size_t XFiber::LiveFibers() const {
+    return live_fibers_;
+}
+
+size_t XFiber::ReadyFibers() const {
+    return ready_count_;
+}
+
+size_t XFiber::LiveConnections() const {
+    return live_connections_;
+}
+
+void XFiber::AddConnections(int delta) {
+    live_connections_ += delta;
+}
+
 void XFiber::Yield() {
     assert(curr_fiber_ != nullptr);
     // 主动切出的后仍然是ready状态，等待下次调度
-    ready_fibers_.push_back(curr_fiber_);
+    PushReady(curr_fiber_);
     SwitchToSched();
 }
 
@@ -166,7 +564,7 @@ void XFiber::SleepMs(int ms) {
 
 void XFiber::TakeOver(int fd) {
     struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
     ev.data.fd = fd;
 
     if (epoll_ctl(efd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
@@ -174,33 +572,45 @@ void XFiber::TakeOver(int fd) {
         exit(-1);
     }
     LOG_DEBUG("add fd[%d] into epoll event success", fd);
+
+    if (busy_poll_ && busy_poll_config_.socket_busy_poll_us_ > 0) {
+        // 非socket（eventfd、pipe等）设置会返回ENOTSOCK，直接忽略
+        int usecs = busy_poll_config_.socket_busy_poll_us_;
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0 && errno != ENOTSOCK) {
+            LOG_WARNING("set SO_BUSY_POLL on fd[%d] failed, msg=%s", fd, strerror(errno));
+        }
+    }
 }
 
 void XFiber::RegisterWaitingEvents(WaitingEvents &events) {
     assert(curr_fiber_ != nullptr);
     if (events.expire_at_ > 0) {
         expire_events_[events.expire_at_].insert(curr_fiber_);
-        curr_fiber_->SetWaitingEvent(events);
         LOG_DEBUG("register fiber [%lu] with expire event at %ld", curr_fiber_->Seq(), events.expire_at_);
     }
 
     for (size_t i = 0; i < events.waiting_fds_r_.size(); i++) {
         int fd = events.waiting_fds_r_[i];
-        auto iter = io_waiting_fibers_.find(fd);
-        if (iter == io_waiting_fibers_.end()) {
-            io_waiting_fibers_.insert(std::make_pair(fd, WaitingFibers(curr_fiber_, nullptr)));
-            curr_fiber_->SetWaitingEvent(events);
+        WaitingFibers &waiting_fibers = io_waiting_fibers_[fd];
+        if (waiting_fibers.r_ != nullptr && waiting_fibers.r_ != curr_fiber_) {
+            LOG_ERROR("fd[%d] is already read by fiber[%lu], fiber[%lu] can't wait on it", fd, waiting_fibers.r_->Seq(), curr_fiber_->Seq());
+            assert(false);
         }
+        waiting_fibers.r_ = curr_fiber_;
     }
 
     for (size_t i = 0; i < events.waiting_fds_w_.size(); i++) {
         int fd = events.waiting_fds_w_[i];
-        auto iter = io_waiting_fibers_.find(fd);
-        if (iter == io_waiting_fibers_.end()) {
-            io_waiting_fibers_.insert(std::make_pair(fd, WaitingFibers(nullptr, curr_fiber_)));
-            curr_fiber_->SetWaitingEvent(events);
+        WaitingFibers &waiting_fibers = io_waiting_fibers_[fd];
+        if (waiting_fibers.w_ != nullptr && waiting_fibers.w_ != curr_fiber_) {
+            LOG_ERROR("fd[%d] is already written by fiber[%lu], fiber[%lu] can't wait on it", fd, waiting_fibers.w_->Seq(), curr_fiber_->Seq());
+            assert(false);
         }
+        waiting_fibers.w_ = curr_fiber_;
     }
+
+    // 超时和fd一起登记，只能追加一次，否则fd会重复记录
+    curr_fiber_->SetWaitingEvent(events);
 }
 
 bool XFiber::UnregisterFd(int fd) {
@@ -209,15 +619,17 @@ bool XFiber::UnregisterFd(int fd) {
     // assert(io_waiting_fibers_iter != io_waiting_fibers_.end());
 
     if (io_waiting_fibers_iter != io_waiting_fibers_.end()) {
-        WaitingFibers &waiting_fibers = io_waiting_fibers_iter->second;
-        if (waiting_fibers.r_ != nullptr) {
-            WakeupFiber(waiting_fibers.r_);
+        Fiber *r_fiber = io_waiting_fibers_iter->second.r_;
+        Fiber *w_fiber = io_waiting_fibers_iter->second.w_;
+        if (r_fiber != nullptr) {
+            WakeupFiber(r_fiber);
         }
-        if (waiting_fibers.w_ != nullptr) {
-            WakeupFiber(waiting_fibers.w_);
+        if (w_fiber != nullptr) {
+            WakeupFiber(w_fiber);
         }
 
-        io_waiting_fibers_.erase(io_waiting_fibers_iter);
+        // WakeupFiber已经清理过槽位，这里防止残留
+        io_waiting_fibers_.erase(fd);
     }
 
     struct epoll_event ev;
@@ -248,6 +660,9 @@ Fiber::Fiber(std::function<void ()> run, XFiber *xfiber, size_t stack_size, std:
 
     seq_ = fiber_seq++;
     status_ = FiberStatus::INIT;
+    ready_at_us_ = 0;
+    ready_by_io_ = false;
+    queue_delay_us_ = 0;
 }
 
 Fiber::~Fiber() {
@@ -274,10 +689,39 @@ std::string Fiber::Name() {
     return fiber_name_;
 }
 
+FiberStatus Fiber::Status() {
+    return status_;
+}
+
+void Fiber::SetStatus(FiberStatus status) {
+    status_ = status;
+}
+
 bool Fiber::IsFinished() {
     return status_ == FiberStatus::FINISHED;
 }
 
+void Fiber::SetReadyAt(int64_t ready_at_us, bool by_io) {
+    ready_at_us_ = ready_at_us;
+    ready_by_io_ = by_io;
+}
+
+bool Fiber::ReadyByIo() {
+    return ready_by_io_;
+}
+
+int64_t Fiber::ReadyAt() {
+    return ready_at_us_;
+}
+
+void Fiber::SetQueueDelay(int64_t delay_us) {
+    queue_delay_us_ = delay_us;
+}
+
+int64_t Fiber::QueueDelayUs() {
+    return queue_delay_us_;
+}
+
 void Fiber::SetWaitingEvent(const WaitingEvents &events) {
     for (size_t i = 0; i < events.waiting_fds_r_.size(); i++) {
         waiting_events_.waiting_fds_r_.push_back(events.waiting_fds_r_[i]);
@@ -2,15 +2,19 @@
 
 #include <set>
 #include <map>
+#include <atomic>
 #include <list>
 #include <queue>
 #include <vector>
 #include <string>
 #include <functional>
 #include <ucontext.h>
+#include <sys/epoll.h>
 
 #include "log.h"
 #include "util.h"
+#include "mpsc_queue.h"
+#include "xtrace.h"
 
 typedef enum {
     INIT = 0,
@@ -43,6 +47,60 @@ struct WaitingEvents {
 
 class Fiber;
 
+// 忙轮询配置：空闲时先用零超时的epoll_wait自旋一段时间再阻塞，省去线程睡眠/唤醒的开销
+// 以占满一个CPU为代价换取更低更稳定的尾延迟，需要给调度线程独占核心
+struct BusyPollConfig {
+    BusyPollConfig() {
+        max_spin_us_ = 50;
+        min_spin_us_ = 2;
+        adaptive_ = true;
+        socket_busy_poll_us_ = 0;
+        cpu_ = -1;
+    }
+
+    // 每次空闲最多自旋的时长，不开启自适应时固定为该值
+    int max_spin_us_;
+
+    // 自适应时的最小自旋时长，事件稀疏时保留一点探测
+    int min_spin_us_;
+
+    // 根据最近的事件到达间隔调整自旋时长
+    bool adaptive_;
+
+    // >0时对之后TakeOver的socket设置SO_BUSY_POLL，并设置epoll的忙轮询参数（需要内核支持）
+    // 超过net.core.busy_read时需要CAP_NET_ADMIN
+    int socket_busy_poll_us_;
+
+    // >=0时把调度线程绑定到该CPU
+    int cpu_;
+};
+
+// 过载保护配置，各项为0表示不限制，默认全部关闭
+struct OverloadConfig {
+    OverloadConfig() {
+        max_fibers_ = 0;
+        max_connections_ = 0;
+        max_ready_fibers_ = 0;
+        target_delay_us_ = 0;
+        interval_ms_ = 100;
+    }
+
+    // 存活协程上限，达到后暂停accept，TryCreateFiber失败
+    size_t max_fibers_;
+
+    // 存活TCP连接上限（含主动发起的连接），达到后暂停accept
+    size_t max_connections_;
+
+    // 就绪协程数超过该值时暂停accept
+    size_t max_ready_fibers_;
+
+    // 排队延迟（从唤醒到被调度运行）的目标值，开启后按CoDel的思路判断过载
+    int64_t target_delay_us_;
+
+    // CoDel的观察窗口，窗口内的最小排队延迟都超过目标才认为过载
+    int interval_ms_;
+};
+
 class XFiber {
 public:
     XFiber();
@@ -55,6 +113,9 @@ public:
 
     void Dispatch();
 
+    // 让Dispatch在本轮结束后返回，只能在调度线程调用（其他线程通过Post）
+    void Stop();
+
     void Yield();
 
     void SwitchToSched();
@@ -67,15 +128,134 @@ public:
 
     void SleepMs(int ms);
 
+    // 开启忙轮询，必须在调度线程调用（绑核作用于调用线程）；CPU绑定失败返回false
+    bool EnableBusyPoll(const BusyPollConfig &config);
+
+    void DisableBusyPoll();
+
+    // 当前的自旋时长，未开启时为0
+    int SpinBudgetUs() const;
+
+    void SetOverloadConfig(const OverloadConfig &config);
+
+    // 和CreateFiber相同，但存活协程数达到上限时直接返回false
+    bool TryCreateFiber(std::function<void()> run, size_t stack_size = 0, std::string fiber_name="");
+
+    // 是否应该暂停accept，让新连接留在内核的backlog里
+    bool AcceptPaused() const;
+
+    // 上一个观察窗口的最小排队延迟超过了目标
+    bool Overloaded() const;
+
+    // 过载时，当前协程本次等待调度的时间超过目标的两倍，说明它处理的请求已经排队太久，
+    // 调用方应该直接返回协议层的错误（如HTTP 503、RESP -BUSY），把资源留给还来得及处理的请求
+    // 每次唤醒只有第一次调用可能返回true，调用方应在一次读到的一批请求前调用一次
+    bool ShouldShed();
+
+    // 上一个观察窗口内的最小排队延迟
+    int64_t QueueDelayUs() const;
+
+    size_t LiveFibers() const;
+
+    size_t ReadyFibers() const;
+
+    size_t LiveConnections() const;
+
+    // 由Connection在建立/关闭时调用
+    void AddConnections(int delta);
+
     XFiberCtx *SchedCtx();
 
+    Fiber *CurrFiber();
+
+    // 以下两个接口可以在任意线程调用，其余接口只能在本XFiber所在线程调用
+    // 投递一个任务到本调度线程执行，任务运行在调度上下文中，不能阻塞也不能切换协程
+    void Post(std::function<void()> task);
+
+    // 跨线程唤醒一个协程，协程需要先把自己交给其他线程，再调用SwitchToSched挂起，
+    // 挂起前不能因为其他原因切出，否则会被提前唤醒
+    void RemoteWakeup(Fiber *fiber);
+
     static XFiber *xfiber() {
         static thread_local XFiber xf;
         return &xf;
     }
 
 private:
+    struct RemoteTask {
+        RemoteTask() : fiber_(nullptr) {}
+        std::function<void()> task_;
+        Fiber *fiber_;
+    };
+
+    void PushRemote(RemoteTask task);
+
+    // 在调度线程中批量处理其他线程投递的任务/唤醒
+    void DrainRemote();
+
+    // 等待IO事件，开启忙轮询且允许阻塞时先自旋
+    int PollEvents(struct epoll_event *evs, int max_events, int timeout_ms);
+
+    // 根据本次空闲到事件到达的间隔更新自旋时长
+    void AdaptSpinBudget(int64_t gap_us);
+
+    // 协程进入就绪队列
+    void PushReady(Fiber *fiber);
+
+    // 记录一次排队延迟，窗口结束时更新过载状态
+    void UpdateQueueDelay(int64_t delay_us, int64_t now_us);
+
+    // 观察窗口到期时根据窗口内的最小排队延迟和就绪队列更新过载状态，并开始新窗口
+    void CheckOverload(int64_t now_us);
+
     int efd_;
+
+    bool stopped_;
+
+    bool busy_poll_;
+
+    BusyPollConfig busy_poll_config_;
+
+    int spin_budget_us_;
+
+    // 空闲到事件到达间隔的滑动平均（微秒）的8倍，<0表示还没有样本
+    int64_t idle_gap_x8_;
+
+    OverloadConfig overload_config_;
+
+    size_t live_fibers_;
+
+    // 处于READYING状态的协程数，包括本轮还没轮到运行的
+    size_t ready_count_;
+
+    size_t live_connections_;
+
+    // 当前窗口内的最小排队延迟
+    int64_t min_delay_us_;
+
+    // 上一个窗口的最小排队延迟
+    int64_t last_min_delay_us_;
+
+    int64_t interval_end_us_;
+
+    bool overloaded_;
+
+    // 上一次epoll_wait返回的时间
+    int64_t last_poll_us_;
+
+    // 非0时作为本轮IO事件唤醒的协程进入就绪队列的时间
+    int64_t io_ready_at_us_;
+
+    // 本线程的调度事件记录器
+    Tracer *tracer_;
+
+    // 跨线程通知用的eventfd
+    int notify_fd_;
+
+    // 已经写过eventfd且尚未被消费时为true，用于合并多次通知
+    std::atomic<bool> notified_;
+
+    MpscQueue<RemoteTask> remote_tasks_;
     
     std::deque<Fiber *> ready_fibers_;
 
@@ -93,9 +273,9 @@ private:
         }
     };
 
+    // 每个fd分读/写两个槽位，允许一个协程读、另一个协程写同一个连接（全双工）
+    // 同一方向同时只能有一个协程等待
     std::map<int, WaitingFibers> io_waiting_fibers_;
-    // 会不会出现一个fd的读/写被多个协程监听？？不会！
-    // 但是一个fiber可能会监听多个fd，实际也不存在，一个连接由一个协程处理
 
     std::map<int64_t, std::set<Fiber *>> expire_events_;
 
@@ -115,6 +295,10 @@ public:
     std::string Name();
 
     bool IsFinished();
+
+    FiberStatus Status();
+
+    void SetStatus(FiberStatus status);
     
     uint64_t Seq();
 
@@ -139,6 +323,18 @@ public:
 
     void SetWaitingEvent(const WaitingEvents &events);
 
+    // 进入就绪队列的时间及是否由IO事件唤醒，只在开启排队延迟测量时记录
+    void SetReadyAt(int64_t ready_at_us, bool by_io);
+
+    int64_t ReadyAt();
+
+    bool ReadyByIo();
+
+    // 最近一次从唤醒到运行的等待时间
+    void SetQueueDelay(int64_t delay_us);
+
+    int64_t QueueDelayUs();
+
 private:
     uint64_t seq_;
 
@@ -158,5 +354,10 @@ private:
 
     WaitingEvents waiting_events_;
 
+    int64_t ready_at_us_;
+
+    bool ready_by_io_;
+
+    int64_t queue_delay_us_;
 };
 
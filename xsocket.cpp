@@ -18,7 +18,7 @@ bool Fd::Available() {
     return fd_ > 0;
 }
 
-int Fd::RawFd() {
+int Fd::RawFd() const {
     return fd_;
 }
 
@@ -64,7 +64,7 @@ Listener Listener::ListenTCP(uint16_t port) {
     }
 
     //listen
-    if (listen(fd, 10) < 0) {
+    if (listen(fd, SOMAXCONN) < 0) {
         LOG_ERROR("try listen port[%d] failed, msg=%s", port, strerror(errno));
         exit(-1);
     }
@@ -86,6 +86,13 @@ std::shared_ptr<Connection> Listener::Accept() {
     XFiber *xfiber = XFiber::xfiber();
 
     while (true) {
+        // 过载时不再accept，新连接留在内核backlog里，backlog满后由内核拒绝，给客户端反压
+        if (xfiber->AcceptPaused()) {
+            LOG_DEBUG("sched is overloaded, pause accept on fd[%d]", fd_);
+            xfiber->SleepMs(1);
+            continue;
+        }
+
         int client_fd = accept(fd_, nullptr, nullptr);
         if (client_fd > 0) {
             if (fcntl(client_fd, F_SETFL, O_NONBLOCK) != 0) {
@@ -126,9 +133,15 @@ Connection::Connection() {
 
 Connection::Connection(int fd) {
     fd_ = fd;
+    if (fd_ > 0) {
+        XFiber::xfiber()->AddConnections(1);
+    }
 }
 
 Connection::~Connection() {
+    if (fd_ > 0) {
+        XFiber::xfiber()->AddConnections(-1);
+    }
     XFiber::xfiber()->UnregisterFd(fd_);
     LOG_INFO("close fd[%d]", fd_);
     close(fd_);
@@ -249,3 +262,280 @@ ssize_t Connection::Read(char *buf, size_t sz, int timeout_ms) const {
     }
     return -1;
 }
+
+
+DatagramSocket::DatagramSocket(int fd) {
+    fd_ = fd;
+}
+
+DatagramSocket::~DatagramSocket() {
+    if (fd_ >= 0) {
+        XFiber::xfiber()->UnregisterFd(fd_);
+        LOG_INFO("close udp fd[%d]", fd_);
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::shared_ptr<DatagramSocket> DatagramSocket::BindUDP(const char *ipv4, uint16_t port, bool reuse_port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("create udp socket failed, msg=%s", strerror(errno));
+        return std::shared_ptr<DatagramSocket>(new DatagramSocket(-1));
+    }
+
+    int flag = 1;
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) < 0) {
+        LOG_ERROR("try set SO_REUSEPORT failed, msg=%s", strerror(errno));
+        close(fd);
+        return std::shared_ptr<DatagramSocket>(new DatagramSocket(-1));
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = ipv4 == nullptr ? htonl(INADDR_ANY) : inet_addr(ipv4);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("try bind udp port [%d] failed, msg=%s", port, strerror(errno));
+        close(fd);
+        return std::shared_ptr<DatagramSocket>(new DatagramSocket(-1));
+    }
+
+    LOG_INFO("bind udp %d success with fd[%d]", port, fd);
+    XFiber::xfiber()->TakeOver(fd);
+    return std::shared_ptr<DatagramSocket>(new DatagramSocket(fd));
+}
+
+uint16_t DatagramSocket::LocalPort() const {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd_, (sockaddr *)&addr, &len) < 0) {
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+bool DatagramSocket::SetBufferSize(int recv_bytes, int send_bytes) {
+    if (recv_bytes > 0 && setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &recv_bytes, sizeof(recv_bytes)) < 0) {
+        LOG_WARNING("try set SO_RCVBUF on fd[%d] failed, msg=%s", fd_, strerror(errno));
+        return false;
+    }
+    if (send_bytes > 0 && setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &send_bytes, sizeof(send_bytes)) < 0) {
+        LOG_WARNING("try set SO_SNDBUF on fd[%d] failed, msg=%s", fd_, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool DatagramSocket::WaitEvent(bool write, int64_t expire_at) const {
+    if (expire_at > 0 && util::NowMs() >= expire_at) {
+        return false;
+    }
+    XFiber *xfiber = XFiber::xfiber();
+    WaitingEvents events;
+    events.expire_at_ = expire_at;
+    if (write) {
+        events.waiting_fds_w_.push_back(fd_);
+    }
+    else {
+        events.waiting_fds_r_.push_back(fd_);
+    }
+    xfiber->RegisterWaitingEvents(events);
+    xfiber->SwitchToSched();
+    return true;
+}
+
+ssize_t DatagramSocket::RecvFrom(char *buf, size_t sz, struct sockaddr_in *from, int timeout_ms) const {
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+    while (true) {
+        socklen_t addr_len = sizeof(struct sockaddr_in);
+        // MSG_TRUNC让内核返回数据报的实际长度，调用方据此发现截断
+        ssize_t n = recvfrom(fd_, buf, sz, MSG_TRUNC, (sockaddr *)from, from == nullptr ? nullptr : &addr_len);
+        if (n >= 0) {
+            return n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            LOG_DEBUG("recvfrom fd[%d] failed, msg=%s", fd_, strerror(errno));
+            return -1;
+        }
+        if (!WaitEvent(false, expire_at)) {
+            LOG_WARNING("recvfrom fd[%d] timeout after wait %dms", fd_, timeout_ms);
+            return 0;
+        }
+    }
+}
+
+ssize_t DatagramSocket::SendTo(const char *buf, size_t sz, const struct sockaddr_in &to, int timeout_ms) const {
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+    while (true) {
+        ssize_t n = sendto(fd_, buf, sz, 0, (const sockaddr *)&to, sizeof(to));
+        if (n >= 0) {
+            return n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            LOG_DEBUG("sendto fd[%d] failed, msg=%s", fd_, strerror(errno));
+            return -1;
+        }
+        if (!WaitEvent(true, expire_at)) {
+            LOG_WARNING("sendto fd[%d] timeout after wait %dms", fd_, timeout_ms);
+            return 0;
+        }
+    }
+}
+
+int DatagramSocket::RecvMany(Datagram *msgs, int n, int timeout_ms) const {
+    if (n > MAX_BATCH) {
+        n = MAX_BATCH;
+    }
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+
+    struct mmsghdr hdrs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    char cmsg_bufs[MAX_BATCH][CMSG_SPACE(sizeof(int))];
+
+    while (true) {
+        for (int i = 0; i < n; i++) {
+            iovs[i].iov_base = msgs[i].buf_;
+            iovs[i].iov_len = msgs[i].cap_;
+            memset(&hdrs[i], 0, sizeof(hdrs[i]));
+            hdrs[i].msg_hdr.msg_name = &msgs[i].addr_;
+            hdrs[i].msg_hdr.msg_namelen = sizeof(msgs[i].addr_);
+            hdrs[i].msg_hdr.msg_iov = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+            hdrs[i].msg_hdr.msg_control = cmsg_bufs[i];
+            hdrs[i].msg_hdr.msg_controllen = sizeof(cmsg_bufs[i]);
+        }
+
+        int ret = recvmmsg(fd_, hdrs, n, MSG_DONTWAIT, nullptr);
+        if (ret > 0) {
+            for (int i = 0; i < ret; i++) {
+                msgs[i].len_ = hdrs[i].msg_len;
+                msgs[i].segment_size_ = 0;
+                msgs[i].truncated_ = (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+                if (msgs[i].truncated_) {
+                    LOG_DEBUG("datagram from fd[%d] truncated to %lu bytes", fd_, msgs[i].len_);
+                }
+                // GRO合并的数据报通过cmsg带回切分大小
+                for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cmsg != nullptr;
+                     cmsg = CMSG_NXTHDR(&hdrs[i].msg_hdr, cmsg)) {
+                    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                        int segment_size = 0;
+                        memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                        msgs[i].segment_size_ = segment_size;
+                    }
+                }
+            }
+            return ret;
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 && errno != EAGAIN) {
+            LOG_DEBUG("recvmmsg fd[%d] failed, msg=%s", fd_, strerror(errno));
+            return -1;
+        }
+        if (!WaitEvent(false, expire_at)) {
+            return 0;
+        }
+    }
+}
+
+int DatagramSocket::SendMany(const Datagram *msgs, int n, int timeout_ms) const {
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+
+    struct mmsghdr hdrs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    int sent = 0;
+
+    while (sent < n) {
+        int batch = n - sent < MAX_BATCH ? n - sent : MAX_BATCH;
+        for (int i = 0; i < batch; i++) {
+            const Datagram &msg = msgs[sent + i];
+            iovs[i].iov_base = msg.buf_;
+            iovs[i].iov_len = msg.len_;
+            memset(&hdrs[i], 0, sizeof(hdrs[i]));
+            hdrs[i].msg_hdr.msg_name = (void *)&msg.addr_;
+            hdrs[i].msg_hdr.msg_namelen = sizeof(msg.addr_);
+            hdrs[i].msg_hdr.msg_iov = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int ret = sendmmsg(fd_, hdrs, batch, MSG_DONTWAIT);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 && errno != EAGAIN) {
+            LOG_DEBUG("sendmmsg fd[%d] failed, msg=%s", fd_, strerror(errno));
+            return sent > 0 ? sent : -1;
+        }
+        if (!WaitEvent(true, expire_at)) {
+            LOG_WARNING("sendmmsg fd[%d] timeout after wait %dms, %d/%d sent", fd_, timeout_ms, sent, n);
+            return sent;
+        }
+    }
+    return sent;
+}
+
+bool DatagramSocket::EnableGRO() {
+    int flag = 1;
+    if (setsockopt(fd_, SOL_UDP, UDP_GRO, &flag, sizeof(flag)) < 0) {
+        LOG_WARNING("try set UDP_GRO on fd[%d] failed, msg=%s", fd_, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+ssize_t DatagramSocket::SendSegmented(const char *buf, size_t sz, size_t segment_size, const struct sockaddr_in &to, int timeout_ms) const {
+    int64_t expire_at = timeout_ms > 0 ? util::NowMs() + timeout_ms : -1;
+
+    struct iovec iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = sz;
+
+    char cmsg_buf[CMSG_SPACE(sizeof(uint16_t))];
+    memset(cmsg_buf, 0, sizeof(cmsg_buf));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)&to;
+    msg.msg_namelen = sizeof(to);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    uint16_t gso_size = segment_size;
+    memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+    while (true) {
+        ssize_t n = sendmsg(fd_, &msg, MSG_DONTWAIT);
+        if (n >= 0) {
+            return n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            LOG_DEBUG("sendmsg with UDP_SEGMENT on fd[%d] failed, msg=%s", fd_, strerror(errno));
+            return -1;
+        }
+        if (!WaitEvent(true, expire_at)) {
+            return 0;
+        }
+    }
+}
@@ -7,6 +7,7 @@
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
@@ -21,7 +22,7 @@ public:
 
     static uint32_t next_seq_;
 
-    int RawFd();
+    int RawFd() const;
 
     void RegisterFdToSched();
 
@@ -43,6 +44,7 @@ public:
 
     ~Listener();
 
+    // XFiber::AcceptPaused()为true（连接/协程数达到上限或调度过载）时暂停，恢复后再accept
     std::shared_ptr<Connection> Accept();
 
     void FromRawFd(int fd);
@@ -68,3 +70,69 @@ public:
 
     ssize_t Read(char *buf, size_t sz, int timeout_ms=-1) const;
 };
+
+
+// 一个数据报，buf_由调用方提供
+struct Datagram {
+    Datagram(char *buf = nullptr, size_t cap = 0) {
+        buf_ = buf;
+        cap_ = cap;
+        len_ = 0;
+        segment_size_ = 0;
+        truncated_ = false;
+        memset(&addr_, 0, sizeof(addr_));
+    }
+
+    char *buf_;
+    // 缓冲区容量
+    size_t cap_;
+    // 收到/待发送的数据长度
+    size_t len_;
+    // 开启GRO时，非0表示buf_中是多个按该大小切分的数据报（最后一个可能更短）
+    size_t segment_size_;
+    // 接收时数据报比cap_大，超出部分已被内核丢弃，len_只是前cap_字节；
+    // DNS这类协议需要据此回复截断错误或者丢弃，不能当成完整报文处理
+    bool truncated_;
+    // 收到时为来源地址，发送时为目的地址
+    struct sockaddr_in addr_;
+};
+
+class DatagramSocket : public Fd {
+public:
+    DatagramSocket(int fd);
+
+    ~DatagramSocket();
+
+    // 绑定本地地址，ipv4为nullptr时绑定INADDR_ANY，port为0时由内核分配
+    // reuse_port为true时开启SO_REUSEPORT，多个线程各自绑定同一端口，由内核按四元组分流
+    static std::shared_ptr<DatagramSocket> BindUDP(const char *ipv4, uint16_t port, bool reuse_port = false);
+
+    // 返回数据报的实际长度，大于sz表示被截断，buf中只有前sz字节
+    ssize_t RecvFrom(char *buf, size_t sz, struct sockaddr_in *from, int timeout_ms = -1) const;
+
+    ssize_t SendTo(const char *buf, size_t sz, const struct sockaddr_in &to, int timeout_ms = -1) const;
+
+    // 用recvmmsg批量接收，至少收到一个才返回；返回收到的个数，0表示超时，-1表示出错
+    int RecvMany(Datagram *msgs, int n, int timeout_ms = -1) const;
+
+    // 用sendmmsg批量发送，返回成功发送的个数，超时或出错时可能小于n
+    int SendMany(const Datagram *msgs, int n, int timeout_ms = -1) const;
+
+    // 开启UDP GRO，内核会把同一来源的连续数据报合并到一次接收中，见Datagram::segment_size_
+    // 开启后接收缓冲应按64KB准备，否则合并的数据报会被截断（Datagram::truncated_为true）
+    bool EnableGRO();
+
+    // 利用UDP GSO把buf按segment_size切成多个数据报一次发出，内核不支持时返回-1
+    ssize_t SendSegmented(const char *buf, size_t sz, size_t segment_size, const struct sockaddr_in &to, int timeout_ms = -1) const;
+
+    uint16_t LocalPort() const;
+
+    // 调整内核收发缓冲区，突发流量下避免丢包，<=0表示不修改
+    bool SetBufferSize(int recv_bytes, int send_bytes);
+
+    static const int MAX_BATCH = 64;
+
+private:
+    // 等待fd可读/可写，超时返回false
+    bool WaitEvent(bool write, int64_t expire_at) const;
+};
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <unordered_map>
+#include "xtrace.h"
+#include "log.h"
+
+
+static int64_t MonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+Tracer::Tracer() {
+    enabled_ = false;
+    sample_every_ = 1;
+    epoll_count_ = 0;
+    mask_ = 0;
+    next_ = 0;
+    base_tsc_ = 0;
+    base_ns_ = 0;
+}
+
+void Tracer::Enable(size_t capacity, uint32_t sample_every) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    events_.assign(size, TraceEvent());
+    mask_ = size - 1;
+    next_ = 0;
+    epoll_count_ = 0;
+    sample_every_ = sample_every > 0 ? sample_every : 1;
+    base_tsc_ = Now();
+    base_ns_ = MonotonicNs();
+    enabled_ = true;
+}
+
+void Tracer::Disable() {
+    enabled_ = false;
+}
+
+static const char *EventName(uint32_t type) {
+    switch (type) {
+        case TRACE_FIBER_CREATE: return "create";
+        case TRACE_FIBER_WAKE: return "wake";
+        case TRACE_TIMER_EXPIRE: return "timer_expire";
+        default: return "unknown";
+    }
+}
+
+bool Tracer::ExportChromeTrace(const std::string &path) {
+    if (events_.empty()) {
+        LOG_WARNING("tracer has never been enabled, nothing to export");
+        return false;
+    }
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        LOG_ERROR("open trace file %s failed, msg=%s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // 用开启以来的tsc增量和单调时钟增量估算tsc频率
+    double elapsed_ns = (double)(MonotonicNs() - base_ns_);
+    double ticks_per_us = elapsed_ns > 0 ? (double)(Now() - base_tsc_) * 1000.0 / elapsed_ns : 1.0;
+    if (ticks_per_us <= 0) {
+        ticks_per_us = 1.0;
+    }
+
+    int pid = getpid();
+    long tid = syscall(SYS_gettid);
+    uint64_t begin = next_ > events_.size() ? next_ - events_.size() : 0;
+
+    // 最近一次被唤醒的时间，用于计算协程从唤醒到真正运行的排队时间
+    std::unordered_map<uint64_t, uint64_t> wake_tsc;
+    const TraceEvent *running = nullptr;
+    bool first = true;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (uint64_t i = begin; i < next_; i++) {
+        const TraceEvent &ev = events_[i & mask_];
+        double ts_us = (double)(int64_t)(ev.tsc_ - base_tsc_) / ticks_per_us;
+
+        switch (ev.type_) {
+            case TRACE_FIBER_RUN:
+                running = &ev;
+                continue;
+
+            case TRACE_FIBER_PARK:
+            case TRACE_FIBER_FINISH: {
+                if (running == nullptr || running->arg_ != ev.arg_) {
+                    continue;
+                }
+                double start_us = (double)(int64_t)(running->tsc_ - base_tsc_) / ticks_per_us;
+                double wait_us = -1;
+                auto iter = wake_tsc.find(ev.arg_);
+                if (iter != wake_tsc.end()) {
+                    wait_us = (double)(running->tsc_ - iter->second) / ticks_per_us;
+                    wake_tsc.erase(iter);
+                }
+                fprintf(fp, "%s{\"name\":\"fiber[%" PRIu64 "]\",\"cat\":\"fiber\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"pid\":%d,\"tid\":%ld,\"args\":{\"wait_us\":%.3f,\"end\":\"%s\"}}",
+                        first ? "" : ",\n", ev.arg_, start_us, ts_us - start_us, pid, tid, wait_us,
+                        ev.type_ == TRACE_FIBER_FINISH ? "finish" : "park");
+                running = nullptr;
+                break;
+            }
+
+            case TRACE_EPOLL_WAIT: {
+                double dur_us = (double)ev.dur_ / ticks_per_us;
+                fprintf(fp, "%s{\"name\":\"epoll_wait\",\"cat\":\"sched\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                        "\"pid\":%d,\"tid\":%ld,\"args\":{\"events\":%" PRIu64 "}}",
+                        first ? "" : ",\n", ts_us - dur_us, dur_us, pid, tid, ev.arg_);
+                break;
+            }
+
+            default:
+                if (ev.type_ == TRACE_FIBER_WAKE || ev.type_ == TRACE_FIBER_CREATE) {
+                    wake_tsc[ev.arg_] = ev.tsc_;
+                }
+                fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"fiber\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                        "\"pid\":%d,\"tid\":%ld,\"args\":{\"fiber\":%" PRIu64 "}}",
+                        first ? "" : ",\n", EventName(ev.type_), ts_us, pid, tid, ev.arg_);
+                break;
+        }
+        first = false;
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    LOG_INFO("export %" PRIu64 " trace event(s) to %s", next_ - begin, path.c_str());
+    return true;
+}
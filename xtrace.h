@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+typedef enum {
+    TRACE_FIBER_CREATE = 0,
+    TRACE_FIBER_WAKE = 1,
+    TRACE_FIBER_RUN = 2,
+    TRACE_FIBER_PARK = 3,
+    TRACE_FIBER_FINISH = 4,
+    TRACE_TIMER_EXPIRE = 5,
+    TRACE_EPOLL_WAIT = 6
+}TraceEventType;
+
+struct TraceEvent {
+    uint64_t tsc_;
+    // 协程事件为协程seq，epoll为返回的事件数
+    uint64_t arg_;
+    // epoll为等待耗时（tsc），其余为0
+    uint64_t dur_;
+    uint32_t type_;
+};
+
+// 每个线程一个的调度事件记录器，定长环形缓冲，写满后覆盖最旧的事件
+// 关闭时每个埋点只有一次分支判断；采样模式下只记录seq能被sample_every整除的协程，
+// 以及每sample_every次epoll等待中的一次
+class Tracer {
+public:
+    Tracer();
+
+    void Enable(size_t capacity = 64 * 1024, uint32_t sample_every = 1);
+
+    void Disable();
+
+    bool Enabled() const {
+        return enabled_;
+    }
+
+    bool SampleFiber(uint64_t seq) const {
+        return enabled_ && seq % sample_every_ == 0;
+    }
+
+    bool SampleEpoll() {
+        return enabled_ && ++epoll_count_ % sample_every_ == 0;
+    }
+
+    void Record(TraceEventType type, uint64_t arg, uint64_t dur = 0) {
+        TraceEvent &ev = events_[next_ & mask_];
+        ev.tsc_ = Now();
+        ev.arg_ = arg;
+        ev.dur_ = dur;
+        ev.type_ = type;
+        next_++;
+    }
+
+    static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+
+    // 导出为Chrome trace-event格式的JSON，可以直接用chrome://tracing或ui.perfetto.dev打开
+    // 只能在记录事件的线程调用
+    bool ExportChromeTrace(const std::string &path);
+
+    static Tracer *tracer() {
+        static thread_local Tracer tracer;
+        return &tracer;
+    }
+
+private:
+    bool enabled_;
+
+    uint32_t sample_every_;
+
+    uint64_t epoll_count_;
+
+    std::vector<TraceEvent> events_;
+
+    size_t mask_;
+
+    // 已经写入的事件总数，events_[next_ & mask_]为下一个写入位置
+    uint64_t next_;
+
+    // 开启时的时钟基准，用于把tsc换算成微秒
+    uint64_t base_tsc_;
+
+    int64_t base_ns_;
+};